@@ -241,3 +241,87 @@ struct RequestWhoAmI
 	{
 	}
 };
+
+// an led that shows a code over and over, bit i of length (msb first) decides the color for bitMs
+struct LEDPattern
+{
+	static constexpr uint32_t msgSize = 22;
+	static constexpr uint32_t id = 1006;
+
+	uint32_t gpio_num;
+
+	// shown for 1 bits
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+
+	// shown for 0 bits, black blinks the led and a second color switches its hue
+	uint8_t offR;
+	uint8_t offG;
+	uint8_t offB;
+
+	uint8_t colorOrder;
+	uint8_t length;
+	uint32_t bits;
+	uint16_t bitMs;
+
+	array<uint8_t, msgSize> toBytes() const
+	{
+		array<uint8_t, msgSize> bytes = {};
+
+		const uint32_t tmp_id = htonl(id);
+		const uint32_t tmp_gpio_num = htonl(gpio_num);
+		const uint32_t tmp_bits = htonl(bits);
+		const uint16_t tmp_bitMs = htons(bitMs);
+		memcpy(bytes.data(), &tmp_id, 4);
+		memcpy(bytes.data() + 4, &tmp_gpio_num, 4);
+
+		bytes[8] = r;
+		bytes[9] = g;
+		bytes[10] = b;
+		bytes[11] = offR;
+		bytes[12] = offG;
+		bytes[13] = offB;
+		bytes[14] = colorOrder;
+		bytes[15] = length;
+		memcpy(bytes.data() + 16, &tmp_bits, 4);
+		memcpy(bytes.data() + 20, &tmp_bitMs, 2);
+
+		return bytes;
+	}
+
+	static optional<LEDPattern> fromBuffer(const span<uint8_t> &buffer)
+	{
+		if (buffer.size() < msgSize)
+			return nullopt;
+
+		uint32_t gpio_num = 0;
+		uint32_t bits = 0;
+		uint16_t bitMs = 0;
+		memcpy(&gpio_num, buffer.data() + 4, 4);
+		memcpy(&bits, buffer.data() + 16, 4);
+		memcpy(&bitMs, buffer.data() + 20, 2);
+
+		LEDPattern pattern(LEDData(ntohl(gpio_num), buffer[8], buffer[9], buffer[10], buffer[14]), ntohl(bits), buffer[15], ntohs(bitMs));
+		pattern.offR = buffer[11];
+		pattern.offG = buffer[12];
+		pattern.offB = buffer[13];
+		return pattern;
+	}
+
+	// blinks on between black
+	LEDPattern(const LEDData &on, uint32_t bits, uint8_t length, uint16_t bitMs)
+		: gpio_num(on.gpio_num), r(on.r), g(on.g), b(on.b), offR(0), offG(0), offB(0), colorOrder(on.colorOrder), length(length), bits(bits), bitMs(bitMs)
+	{
+	}
+
+	LEDPattern()
+	{
+	}
+
+	// bit index of the code, 0 is shown first
+	bool bit(const int index) const
+	{
+		return (bits >> (length - 1 - index)) & 1u;
+	}
+};
@@ -86,9 +86,12 @@ Worker<ControlData> controlDataWorker(controlDataCallback, &controlDataCallbackE
 WhoAmICallbackExtraData whoAmICallbackExtraData{.uid = &uid, .hasUID = &hasUID};
 Worker<WhoAmI> whoAmIWorker(whoAmICallback, &whoAmICallbackExtraData);
 
-Worker<LEDData> ledDataWorker(ledDataCallback);
+LEDBlinker blinker;
+LEDCallbackExtraData ledCallbackExtraData{.blinker = &blinker};
+Worker<LEDData> ledDataWorker(ledDataCallback, &ledCallbackExtraData);
+Worker<LEDPattern> ledPatternWorker(ledPatternCallback, &ledCallbackExtraData);
 
-UDPPacketCallbackExtraData udpPacketCallbackExtraData{.controlDataWorker = &controlDataWorker, .whoAmIWorker = &whoAmIWorker, .ledDataWorker = &ledDataWorker};
+UDPPacketCallbackExtraData udpPacketCallbackExtraData{.controlDataWorker = &controlDataWorker, .whoAmIWorker = &whoAmIWorker, .ledDataWorker = &ledDataWorker, .ledPatternWorker = &ledPatternWorker};
 Worker<UDPPacket<200>> udpPacketWorker(udpPacketCallback, &udpPacketCallbackExtraData);
 
 NetworkTaskExtraData networkTaskExtraData{.udpPacketWorker = &udpPacketWorker, .controlDataWorker = &controlDataWorker, .uid = &uid, .hasUID = &hasUID};
@@ -103,5 +106,7 @@ extern "C" void app_main(void)
     controlDataWorker.start("controlDataWorker");
     whoAmIWorker.start("whoAmIWorker");
     ledDataWorker.start("ledDataWorker");
+    ledPatternWorker.start("ledPatternWorker");
+    blinker.start("ledBlinker");
     udpPacketWorker.start("udpPacketWorker");
 }
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "Messages.hpp"
+#include "LEDWS2812.hpp"
+#include "utils.hpp"
+
+using std::array;
+using std::mutex;
+
+inline void showLED(const uint32_t gpio_num, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t colorOrder)
+{
+    {
+        LEDWS2812 led((gpio_num_t)gpio_num);
+        if (colorOrder == ColorOrder::RGB)
+            led.set(r, g, b);
+        else if (colorOrder == ColorOrder::GRB)
+            led.set(g, r, b);
+    }
+    gpio_set_pull_mode((gpio_num_t)gpio_num, GPIO_PULLDOWN_ONLY);
+}
+
+/*
+    Plays LEDPatterns on their own task, one per gpio. The pc only sees which rotation of
+    the code is playing, so patterns start whenever they arrive and need no clock sync.
+*/
+class LEDBlinker
+{
+private:
+    static constexpr int MAX_PATTERNS = 4;
+    static constexpr int STEP_MS = 5;
+
+    struct Slot
+    {
+        LEDPattern pattern;
+        bool active = false;
+        int shownBit = -1;
+    };
+
+    array<Slot, MAX_PATTERNS> slots;
+    mutex m;
+
+private:
+    static void taskEntryPoint(void *param)
+    {
+        LEDBlinker *self = (LEDBlinker *)param;
+        ESP_LOGI(pcTaskGetName(NULL), "Blinker task started");
+        while (true)
+        {
+            self->step();
+            taskDelayMillis(STEP_MS);
+        }
+    }
+
+    void step()
+    {
+        std::lock_guard<mutex> lock(m);
+        const int64_t nowMs = esp_timer_get_time() / 1000;
+        for (Slot &slot : slots)
+        {
+            const LEDPattern &p = slot.pattern;
+            if (!slot.active || p.length == 0 || p.bitMs == 0)
+                continue;
+
+            const int index = (int)((nowMs / p.bitMs) % p.length);
+            if (index == slot.shownBit)
+                continue;
+            slot.shownBit = index;
+
+            if (p.bit(index))
+                showLED(p.gpio_num, p.r, p.g, p.b, p.colorOrder);
+            else
+                showLED(p.gpio_num, p.offR, p.offG, p.offB, p.colorOrder);
+        }
+    }
+
+public:
+    // replaces the pattern of the same gpio, false when all slots are taken
+    bool set(const LEDPattern &pattern)
+    {
+        std::lock_guard<mutex> lock(m);
+        Slot *free = nullptr;
+        for (Slot &slot : slots)
+        {
+            if (slot.active && slot.pattern.gpio_num == pattern.gpio_num)
+            {
+                free = &slot;
+                break;
+            }
+            if (!slot.active && !free)
+                free = &slot;
+        }
+        if (!free)
+            return false;
+
+        free->pattern = pattern;
+        free->active = true;
+        free->shownBit = -1;
+        return true;
+    }
+
+    // a plain color for the gpio ends its pattern
+    void stop(const uint32_t gpio_num)
+    {
+        std::lock_guard<mutex> lock(m);
+        for (Slot &slot : slots)
+            if (slot.pattern.gpio_num == gpio_num)
+                slot.active = false;
+    }
+
+    bool start(const char *name, const uint32_t stackDepth = 4096, const UBaseType_t priority = tskIDLE_PRIORITY + 2)
+    {
+        return xTaskCreate(taskEntryPoint, name, stackDepth, this, priority, NULL) == pdTRUE;
+    }
+};
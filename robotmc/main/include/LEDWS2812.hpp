@@ -1,7 +1,10 @@
+#pragma once
+
 #include <vector>
 #include <mutex>
 
 #include "driver/rmt_tx.h"
+#include "utils.hpp"
 
 using std::vector;
 using std::mutex;
@@ -5,6 +5,7 @@
 #include "RobotControl2Wv2.hpp"
 #include "UDPSocket.hpp"
 #include "LEDWS2812.hpp"
+#include "LEDBlinker.hpp"
 
 using std::atomic;
 
@@ -13,6 +14,7 @@ struct UDPPacketCallbackExtraData
     Worker<ControlData> *controlDataWorker;
     Worker<WhoAmI> *whoAmIWorker;
     Worker<LEDData> *ledDataWorker;
+    Worker<LEDPattern> *ledPatternWorker;
 };
 template <int N>
 inline bool udpPacketCallback(UDPPacket<N> &incomingData, void *arg)
@@ -45,6 +47,13 @@ inline bool udpPacketCallback(UDPPacket<N> &incomingData, void *arg)
             return true;
         extra->ledDataWorker->submit(data.value());
     }
+    else if (msg_id == LEDPattern::id)
+    {
+        optional<LEDPattern> data = LEDPattern::fromBuffer(payload);
+        if (!data)
+            return true;
+        extra->ledPatternWorker->submit(data.value());
+    }
     else if (msg_id == WhoAmI::id)
     {
         optional<WhoAmI> data = WhoAmI::fromBuffer(payload);
@@ -72,17 +81,25 @@ inline bool controlDataCallback(ControlData &data, void *arg)
     return true;
 }
 
+struct LEDCallbackExtraData
+{
+    LEDBlinker *blinker;
+};
 inline bool ledDataCallback(LEDData &data, void *arg)
 {
+    LEDCallbackExtraData *extra = (LEDCallbackExtraData *)arg;
     ESP_LOGI(pcTaskGetName(NULL), "GPIO NUM: %ld | (%i, %i, %i) | %i", data.gpio_num, data.r, data.g, data.b, data.colorOrder);
-    {
-        LEDWS2812 led((gpio_num_t)data.gpio_num);
-        if (data.colorOrder == ColorOrder::RGB)
-            led.set(data.r, data.g, data.b);
-        else if (data.colorOrder == ColorOrder::GRB)
-            led.set(data.g, data.r, data.b);
-    }
-    gpio_set_pull_mode((gpio_num_t)data.gpio_num, GPIO_PULLDOWN_ONLY);
+    extra->blinker->stop(data.gpio_num);
+    showLED(data.gpio_num, data.r, data.g, data.b, data.colorOrder);
+    return true;
+}
+
+inline bool ledPatternCallback(LEDPattern &data, void *arg)
+{
+    LEDCallbackExtraData *extra = (LEDCallbackExtraData *)arg;
+    ESP_LOGI(pcTaskGetName(NULL), "GPIO NUM: %ld | code: %lx / %i | %i ms", data.gpio_num, data.bits, data.length, data.bitMs);
+    if (!extra->blinker->set(data))
+        ESP_LOGE(pcTaskGetName(NULL), "No room for another pattern");
     return true;
 }
 
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+using std::atomic;
+
+struct AllocationStats
+{
+	uint64_t frames;
+
+	// allocations of the last frame
+	uint64_t lastFrame;
+
+	// allocations of all frames after the warm up ones and the most any of them made,
+	// both stay 0 for a loop that does not allocate once it is warm
+	uint64_t steady;
+	uint64_t worstFrame;
+};
+
+/*
+	Counts the heap allocations of a frame loop, so it can be shown that the loop stops
+	allocating once it is warm.
+
+	The global operator new of main.cpp counts every allocation to the counter the
+	allocating thread is attached to, threads attached to none are not counted. cv::Mat
+	buffers are counted too, OpenCV creates each one together with a UMatData through
+	operator new. WorkerPool threads count to the counter of whoever called run while they
+	work for it. Plain malloc from C libraries, libjpeg keeps its images in pools of its own,
+	is not seen.
+
+	The first warmupFrames frames are left out of steady, buffers grow to their final size
+	during them.
+*/
+class AllocationCounter
+{
+private:
+	inline static thread_local constinit AllocationCounter *current = nullptr;
+
+	const uint64_t warmupFrames;
+	atomic<uint64_t> allocations{0};
+
+	// touched by the loop thread only
+	uint64_t frameStart = 0;
+
+	// written by the loop thread only, atomic so stats can be read from any thread
+	atomic<uint64_t> frames{0};
+	atomic<uint64_t> lastFrame{0};
+	atomic<uint64_t> steady{0};
+	atomic<uint64_t> worstFrame{0};
+
+	AllocationCounter(const AllocationCounter &) = delete;
+	AllocationCounter &operator=(const AllocationCounter &) = delete;
+
+public:
+	// attaches the calling thread to a counter until it goes out of scope
+	class Scope
+	{
+	private:
+		AllocationCounter *previous;
+
+	public:
+		Scope(AllocationCounter *counter)
+			: previous(current)
+		{
+			current = counter;
+		}
+
+		~Scope()
+		{
+			current = previous;
+		}
+	};
+
+	AllocationCounter(const uint64_t warmupFrames = 0)
+		: warmupFrames(warmupFrames)
+	{
+	}
+
+	// the counter of the calling thread, nullptr when it is not attached
+	static AllocationCounter *attached()
+	{
+		return current;
+	}
+
+	// called by operator new, must not allocate
+	static void count()
+	{
+		if (current)
+			current->allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// call at the end of every frame of the loop
+	void frameDone()
+	{
+		const uint64_t now = allocations.load(std::memory_order_relaxed);
+		const uint64_t used = now - frameStart;
+		frameStart = now;
+		lastFrame.store(used);
+		if (frames.fetch_add(1) >= warmupFrames)
+		{
+			steady.fetch_add(used);
+			worstFrame.store(std::max(worstFrame.load(), used));
+		}
+	}
+
+	AllocationStats stats() const
+	{
+		return {
+			.frames = frames.load(),
+			.lastFrame = lastFrame.load(),
+			.steady = steady.load(),
+			.worstFrame = worstFrame.load(),
+		};
+	}
+};
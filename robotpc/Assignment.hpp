@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <span>
+#include <vector>
+
+using std::span;
+using std::vector;
+
+/*
+	Minimum cost assignment of rows to columns, the Hungarian algorithm with potentials in
+	O(rows^2 * cols).
+
+	Pairs that must not be made cost INFEASIBLE. When there are more rows than columns the
+	missing columns are made up and cost INFEASIBLE too, rows that end up on one of those or
+	on an infeasible pair are left unassigned. All storage is reused between calls.
+*/
+class Assignment
+{
+public:
+	inline static const float INFEASIBLE = 1e6f;
+
+private:
+	// 1-based as in the textbook version, index 0 is the row or column being added
+	vector<double> u;
+	vector<double> v;
+	vector<double> minv;
+	vector<int> match;
+	vector<int> way;
+	vector<char> used;
+
+public:
+	// costs is rows x cols row major, rowToCol[r] becomes the column of row r or -1
+	void solve(span<const float> costs, const int rows, const int cols, vector<int> &rowToCol)
+	{
+		rowToCol.assign(rows, -1);
+		if (rows == 0 || cols == 0)
+			return;
+
+		const int n = rows;
+		const int m = std::max(rows, cols);
+		auto cost = [&](const int r, const int c)
+		{ return c < cols ? (double)costs[(size_t)r * cols + c] : (double)INFEASIBLE; };
+
+		u.assign(n + 1, 0.);
+		v.assign(m + 1, 0.);
+		match.assign(m + 1, 0);
+		way.assign(m + 1, 0);
+		for (int r = 1; r <= n; r++)
+		{
+			match[0] = r;
+			int c0 = 0;
+			minv.assign(m + 1, std::numeric_limits<double>::infinity());
+			used.assign(m + 1, 0);
+			do
+			{
+				used[c0] = 1;
+				const int r0 = match[c0];
+				double delta = std::numeric_limits<double>::infinity();
+				int c1 = 0;
+				for (int c = 1; c <= m; c++)
+				{
+					if (used[c])
+						continue;
+					const double reduced = cost(r0 - 1, c - 1) - u[r0] - v[c];
+					if (reduced < minv[c])
+					{
+						minv[c] = reduced;
+						way[c] = c0;
+					}
+					if (minv[c] < delta)
+					{
+						delta = minv[c];
+						c1 = c;
+					}
+				}
+				for (int c = 0; c <= m; c++)
+				{
+					if (used[c])
+					{
+						u[match[c]] += delta;
+						v[c] -= delta;
+					}
+					else
+					{
+						minv[c] -= delta;
+					}
+				}
+				c0 = c1;
+			} while (match[c0] != 0);
+
+			// flip the augmenting path
+			do
+			{
+				const int c1 = way[c0];
+				match[c0] = match[c1];
+				c0 = c1;
+			} while (c0);
+		}
+
+		for (int c = 1; c <= cols; c++)
+		{
+			const int r = match[c] - 1;
+			if (r >= 0 && costs[(size_t)r * cols + (c - 1)] < INFEASIBLE)
+				rowToCol[r] = c - 1;
+		}
+	}
+};
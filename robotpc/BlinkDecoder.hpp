@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "Blob.hpp"
+#include "Point.hpp"
+
+using std::array;
+using std::map;
+using std::optional;
+using std::span;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+/*
+	Blink codes are length bit words an led shows msb first over and over, one bit every
+	bitSeconds. Robots start their codes whenever they like, so a code is only known up to
+	rotation and two codes must not be rotations of each other. Each code is stored as its
+	smallest rotation.
+*/
+class BlinkCodes
+{
+public:
+	inline static const int MAX_LENGTH = 16;
+
+	static uint32_t rotate(const uint32_t bits, const int length, const int by)
+	{
+		const uint32_t mask = (1u << length) - 1u;
+		return ((bits << by) | (bits >> (length - by))) & mask;
+	}
+
+	static uint32_t canonical(const uint32_t bits, const int length)
+	{
+		uint32_t smallest = bits;
+		for (int by = 1; by < length; by++)
+			smallest = std::min(smallest, rotate(bits, length, by));
+		return smallest;
+	}
+
+	// the n-th code of length that is neither always on nor always off, nullopt when there are fewer
+	static optional<uint32_t> nth(const int n, const int length)
+	{
+		if (length < 2 || length > MAX_LENGTH)
+			return std::nullopt;
+
+		int found = 0;
+		for (uint32_t bits = 1; bits < (1u << length) - 1u; bits++)
+		{
+			if (canonical(bits, length) != bits)
+				continue;
+			if (found++ == n)
+				return bits;
+		}
+		return std::nullopt;
+	}
+};
+
+// a robot recognized by its blink code
+struct BlinkRobot
+{
+	uint8_t uid;
+	Point2D centerPixel;
+	Point2D frontPixel;
+};
+
+/*
+	Follows the center leds of robots that share colors and reads the blink code of their
+	front leds to tell them apart.
+
+	Every frame each track records whether a front blob was next to its center. For each of
+	a few phases within a bit the samples are folded into length slots, a slot is on when
+	most of its samples are, and the phase whose slots agree best with their samples gives
+	the code. The robot clock never has to match ours, only the bit time.
+
+	While the front led is off its position is the last offset it was seen at.
+*/
+class BlinkTracker
+{
+private:
+	// phases tried per bit
+	inline static const int PHASES = 4;
+
+	// fraction of samples that have to agree with the code read from them
+	inline static const float MIN_AGREEMENT = 0.85f;
+
+	// samples of this many code repetitions are kept, 1.5 of them are needed to read it
+	inline static const float HISTORY_CYCLES = 2.f;
+	inline static const float MIN_CYCLES = 1.5f;
+
+	inline static const int MAX_MISSES = 5;
+
+	struct Sample
+	{
+		float t;
+		bool on;
+	};
+
+	// tracks that end are kept with active false and reused with their sample buffers, so a
+	// tracker that saw as many robots as it will ever see does not allocate anymore
+	struct Track
+	{
+		bool active = false;
+		Point2D center;
+		optional<Point2D> frontOffset;
+		bool matched = false;
+		int misses = 0;
+		vector<Sample> samples;
+		optional<uint8_t> uid;
+		float agreement = 0.f;
+	};
+
+	float bitSeconds;
+	int length = 0;
+	float gate;
+	map<uint32_t, uint8_t> codes;
+
+	vector<Track> tracks;
+	optional<time_point<steady_clock>> start;
+
+private:
+	void decode(Track &track) const
+	{
+		const vector<Sample> &samples = track.samples;
+		const float cycle = bitSeconds * length;
+		if (samples.size() < (size_t)length || samples.back().t - samples.front().t < MIN_CYCLES * cycle)
+			return;
+
+		float bestAgreement = 0.f;
+		uint32_t bestBits = 0;
+		for (int phase = 0; phase < PHASES; phase++)
+		{
+			const float shift = bitSeconds * phase / PHASES;
+			array<int, BlinkCodes::MAX_LENGTH> on = {};
+			array<int, BlinkCodes::MAX_LENGTH> count = {};
+			for (const Sample &sample : samples)
+			{
+				const int slot = (int)std::floor((sample.t + shift) / bitSeconds) % length;
+				count[slot]++;
+				on[slot] += sample.on;
+			}
+
+			uint32_t bits = 0;
+			int agree = 0;
+			bool covered = true;
+			for (int slot = 0; slot < length; slot++)
+			{
+				covered = covered && count[slot] > 0;
+				const bool bit = 2 * on[slot] > count[slot];
+				bits = (bits << 1) | (bit ? 1u : 0u);
+				agree += bit ? on[slot] : count[slot] - on[slot];
+			}
+
+			const float agreement = (float)agree / samples.size();
+			if (covered && agreement > bestAgreement)
+			{
+				bestAgreement = agreement;
+				bestBits = bits;
+			}
+		}
+
+		if (bestAgreement < MIN_AGREEMENT)
+			return;
+		const auto code = codes.find(BlinkCodes::canonical(bestBits, length));
+		if (code == codes.end())
+			return;
+		track.uid = code->second;
+		track.agreement = bestAgreement;
+	}
+
+	// a uid belongs to the track that reads it best
+	void resolveDuplicates()
+	{
+		array<int, 256> owner;
+		owner.fill(-1);
+		for (int i = 0; i < (int)tracks.size(); i++)
+		{
+			if (!tracks[i].uid)
+				continue;
+			int &best = owner[tracks[i].uid.value()];
+			if (best < 0 || tracks[i].agreement > tracks[best].agreement)
+			{
+				if (best >= 0)
+					tracks[best].uid = std::nullopt;
+				best = i;
+			}
+			else
+			{
+				tracks[i].uid = std::nullopt;
+			}
+		}
+	}
+
+public:
+	// gate is how far in pixels a center led may move between two frames and still be the same robot
+	BlinkTracker(const float bitSeconds, const float gate = 40.f)
+		: bitSeconds(bitSeconds),
+		  gate(gate)
+	{
+	}
+
+	// all codes of a tracker have the same length, false when it differs or the code is a rotation of another one
+	bool addCode(const uint32_t bits, const int length, const uint8_t uid)
+	{
+		if (length < 2 || length > BlinkCodes::MAX_LENGTH || (this->length && length != this->length))
+			return false;
+		this->length = length;
+		return codes.emplace(BlinkCodes::canonical(bits, length), uid).second;
+	}
+
+	// frontReach is the largest distance in pixels between the center and front led of a robot
+	void update(const time_point<steady_clock> now, span<const Blob> centers, span<const Blob> fronts, const float frontReach)
+	{
+		if (!start)
+			start = now;
+		const float t = duration<float>(now - start.value()).count();
+
+		for (Track &track : tracks)
+			track.matched = false;
+
+		// largest blobs first, they are the least likely to be noise
+		for (const Blob &blob : centers)
+		{
+			Track *nearest = nullptr;
+			float nearestDistance = gate;
+			for (Track &track : tracks)
+			{
+				if (!track.active || track.matched)
+					continue;
+				const float distance = std::hypot(track.center.x - blob.centroid.x, track.center.y - blob.centroid.y);
+				if (distance < nearestDistance)
+				{
+					nearestDistance = distance;
+					nearest = &track;
+				}
+			}
+			if (!nearest)
+			{
+				auto unused = std::find_if(tracks.begin(), tracks.end(), [](const Track &track)
+										   { return !track.active; });
+				if (unused == tracks.end())
+				{
+					tracks.emplace_back();
+					unused = tracks.end() - 1;
+				}
+				nearest = &*unused;
+				nearest->active = true;
+				nearest->frontOffset = std::nullopt;
+				nearest->samples.clear();
+				nearest->uid = std::nullopt;
+				nearest->agreement = 0.f;
+			}
+
+			nearest->center = blob.centroid;
+			nearest->matched = true;
+			nearest->misses = 0;
+
+			const Blob *front = nullptr;
+			float frontDistance = frontReach;
+			for (const Blob &candidate : fronts)
+			{
+				const float distance = std::hypot(candidate.centroid.x - blob.centroid.x, candidate.centroid.y - blob.centroid.y);
+				if (distance < frontDistance)
+				{
+					frontDistance = distance;
+					front = &candidate;
+				}
+			}
+			if (front)
+				nearest->frontOffset = front->centroid - blob.centroid;
+			nearest->samples.push_back({t, front != nullptr});
+		}
+
+		const float history = HISTORY_CYCLES * bitSeconds * length;
+		for (Track &track : tracks)
+		{
+			if (!track.active)
+				continue;
+			if (!track.matched && ++track.misses > MAX_MISSES)
+			{
+				track.active = false;
+				track.uid = std::nullopt;
+				continue;
+			}
+
+			vector<Sample> &samples = track.samples;
+			size_t old = 0;
+			while (old < samples.size() && samples[old].t < t - history)
+				old++;
+			samples.erase(samples.begin(), samples.begin() + old);
+
+			if (track.matched)
+				decode(track);
+		}
+		resolveDuplicates();
+	}
+
+	// robots seen this frame whose code is known and whose front led was seen at least once
+	void robots(vector<BlinkRobot> &found) const
+	{
+		found.clear();
+		for (const Track &track : tracks)
+		{
+			if (!track.matched || !track.uid || !track.frontOffset)
+				continue;
+			found.push_back({
+				.uid = track.uid.value(),
+				.centerPixel = track.center,
+				.frontPixel = track.center + track.frontOffset.value(),
+			});
+		}
+	}
+};
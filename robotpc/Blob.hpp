@@ -0,0 +1,13 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include "Point.hpp"
+
+// a connected group of pixels that share a color class
+struct Blob
+{
+	Point2D centroid;
+	double area;
+	cv::Rect bbox;
+};
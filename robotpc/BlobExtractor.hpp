@@ -0,0 +1,272 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Blob.hpp"
+
+using std::array;
+using std::span;
+using std::vector;
+
+/*
+	Finds 8-connected blobs in a label image in a single pass.
+
+	Every row is split into runs of equal non zero labels. A run is joined with the runs of
+	the previous row that touch it and have the same label, using union-find. Area, bounding
+	box and first order moments are carried by the root of each set and merged on every
+	union, so no second pass over the pixels is needed.
+
+	When a brightness image is given, bgr or the V channel of hsv, centroids are weighted by
+	how much brighter each pixel is than the floor of its label. That gives sub-pixel
+	precision for LEDs whose brightness falls off towards their edges.
+
+	Only the largest maxBlobsPerLabel blobs of each label are kept. All storage is reused
+	between frames, after the first few frames no allocations take place.
+*/
+class BlobExtractor
+{
+private:
+	struct Run
+	{
+		int x0;
+		int x1;
+		uint8_t label;
+		int parent;
+
+		// valid only while the run is the root of its set
+		double area;
+		double sumX;
+		double sumY;
+		double weight;
+		double weightX;
+		double weightY;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+
+private:
+	const int maxLabel;
+	const int maxBlobsPerLabel;
+	const double minArea;
+
+	vector<Run> runs;
+
+	// brightness below which a pixel does not count in the weighted centroid, per label
+	array<uint8_t, 256> weightFloors = {};
+
+	// largest blobs of each label sorted by area, blobs[label * maxBlobsPerLabel + i]
+	vector<Blob> blobs;
+	vector<int> counts;
+
+private:
+	int find(int i)
+	{
+		while (runs[i].parent != i)
+		{
+			runs[i].parent = runs[runs[i].parent].parent;
+			i = runs[i].parent;
+		}
+		return i;
+	}
+
+	void unite(int a, int b)
+	{
+		a = find(a);
+		b = find(b);
+		if (a == b)
+			return;
+		if (a > b)
+			std::swap(a, b);
+
+		// keep the older run as root
+		Run &root = runs[a];
+		const Run &other = runs[b];
+		root.area += other.area;
+		root.sumX += other.sumX;
+		root.sumY += other.sumY;
+		root.weight += other.weight;
+		root.weightX += other.weightX;
+		root.weightY += other.weightY;
+		root.minX = std::min(root.minX, other.minX);
+		root.minY = std::min(root.minY, other.minY);
+		root.maxX = std::max(root.maxX, other.maxX);
+		root.maxY = std::max(root.maxY, other.maxY);
+		runs[b].parent = a;
+	}
+
+	// channels is 3 when value is a bgr row and 1 when it holds V already
+	void addRun(const int x0, const int x1, const int y, const uint8_t label, const uint8_t *value, const int channels)
+	{
+		const double length = x1 - x0 + 1;
+
+		int64_t weight = 0;
+		int64_t weightX = 0;
+		if (value)
+		{
+			const int floor = weightFloors[label];
+			for (int x = x0; x <= x1; x++)
+			{
+				const uint8_t *p = value + channels * x;
+				const int v = channels == 3 ? std::max(std::max(p[0], p[1]), p[2]) : p[0];
+				const int w = v - floor;
+				if (w <= 0)
+					continue;
+				weight += w;
+				weightX += w * x;
+			}
+		}
+
+		runs.push_back({
+			.x0 = x0,
+			.x1 = x1,
+			.label = label,
+			.parent = (int)runs.size(),
+			.area = length,
+			.sumX = length * (x0 + x1) * 0.5,
+			.sumY = length * y,
+			.weight = (double)weight,
+			.weightX = (double)weightX,
+			.weightY = (double)weight * y,
+			.minX = x0,
+			.minY = y,
+			.maxX = x1,
+			.maxY = y,
+		});
+	}
+
+	void keep(const Blob &blob, const uint8_t label)
+	{
+		Blob *top = blobs.data() + label * maxBlobsPerLabel;
+		int &count = counts[label];
+
+		int i = maxBlobsPerLabel - 1;
+		if (count < maxBlobsPerLabel)
+			i = count++;
+		else if (top[i].area >= blob.area)
+			return;
+
+		while (i > 0 && top[i - 1].area < blob.area)
+		{
+			top[i] = top[i - 1];
+			i--;
+		}
+		top[i] = blob;
+	}
+
+public:
+	BlobExtractor(const int maxLabel, const int maxBlobsPerLabel, const double minArea = 1.)
+		: maxLabel(maxLabel),
+		  maxBlobsPerLabel(maxBlobsPerLabel),
+		  minArea(minArea),
+		  blobs((maxLabel + 1) * maxBlobsPerLabel),
+		  counts(maxLabel + 1, 0)
+	{
+	}
+
+	// pixels of label with V <= floor get no weight
+	void setWeightFloor(const uint8_t label, const uint8_t floor)
+	{
+		weightFloors[label] = floor;
+	}
+
+	// forgets the blobs of the previous frame
+	void begin()
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+	}
+
+	// adds the blobs of labels (CV_8UC1), offset is added to all coordinates
+	// value (bgr CV_8UC3 or V CV_8UC1, same size as labels) is optional and enables weighted centroids
+	void extract(const cv::Mat &labels, const cv::Point offset = cv::Point(), const cv::Mat &value = cv::Mat())
+	{
+		runs.clear();
+
+		int prevBegin = 0;
+		int prevEnd = 0;
+		for (int y = 0; y < labels.rows; y++)
+		{
+			const uint8_t *row = labels.ptr<uint8_t>(y);
+			const uint8_t *valueRow = value.empty() ? nullptr : value.ptr<uint8_t>(y);
+			const int rowBegin = (int)runs.size();
+
+			for (int x = 0; x < labels.cols;)
+			{
+				const uint8_t label = row[x];
+				if (label == 0 || label > maxLabel)
+				{
+					x++;
+					continue;
+				}
+				const int x0 = x;
+				while (x < labels.cols && row[x] == label)
+					x++;
+				addRun(x0, x - 1, y, label, valueRow, value.channels());
+			}
+			const int rowEnd = (int)runs.size();
+
+			// join with the touching runs of the previous row, both rows are sorted by x
+			int p = prevBegin;
+			for (int c = rowBegin; c < rowEnd; c++)
+			{
+				while (p < prevEnd && runs[p].x1 < runs[c].x0 - 1)
+					p++;
+				for (int q = p; q < prevEnd && runs[q].x0 <= runs[c].x1 + 1; q++)
+				{
+					if (runs[q].label == runs[c].label)
+						unite(q, c);
+				}
+			}
+
+			prevBegin = rowBegin;
+			prevEnd = rowEnd;
+		}
+
+		for (int i = 0; i < (int)runs.size(); i++)
+		{
+			const Run &r = runs[i];
+			if (r.parent != i || r.area < minArea)
+				continue;
+
+			const Point2D centroid = r.weight > 0.
+										 ? Point2D(float(r.weightX / r.weight), float(r.weightY / r.weight))
+										 : Point2D(float(r.sumX / r.area), float(r.sumY / r.area));
+
+			keep({.centroid = centroid + Point2D(float(offset.x), float(offset.y)),
+				  .area = r.area,
+				  .bbox = cv::Rect(r.minX + offset.x, r.minY + offset.y, r.maxX - r.minX + 1, r.maxY - r.minY + 1)},
+				 r.label);
+		}
+	}
+
+	// adds a blob found some other way, as if it had been extracted here
+	void add(const uint8_t label, const Blob &blob)
+	{
+		if (label <= maxLabel)
+			keep(blob, label);
+	}
+
+	// adds the blobs other found since its begin
+	void add(const BlobExtractor &other)
+	{
+		for (int label = 1; label <= std::min(maxLabel, other.maxLabel); label++)
+		{
+			for (const Blob &blob : other.get((uint8_t)label))
+				keep(blob, (uint8_t)label);
+		}
+	}
+
+	// largest blobs of label found since begin, largest first
+	span<const Blob> get(const uint8_t label) const
+	{
+		if (label > maxLabel)
+			return {};
+		return span<const Blob>(blobs.data() + label * maxBlobsPerLabel, counts[label]);
+	}
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "YUVKernel.hpp"
+
+using std::vector;
+
+/*
+	Finds the tiles of a frame that changed since they were last accepted.
+
+	Every BLOCK x BLOCK block of the frame is reduced to its brightest pixel, luma for yuv,
+	so a small LED turning on or off still changes its block by a lot where an average
+	would hide it in the floor around it. A tile is dirty when any of its blocks differs
+	from the reference by more than threshold, and dirty tiles grow by one tile on every
+	side so a moving LED is inside them whole.
+
+	Only the tiles that were reported get their reference updated, a tile that drifts
+	slowly is compared with how it looked when it was last labeled and is reported once
+	the drift adds up.
+*/
+class ChangeMask
+{
+public:
+	inline static const int TILE = 32;
+
+private:
+	inline static const int BLOCK = 4;
+	inline static const int BLOCKS_PER_TILE = TILE / BLOCK;
+
+	int threshold;
+	cv::Size frameSize;
+	bool valid = false;
+	float dirtyFraction = 1.f;
+
+	// brightest pixel of every block, now and when its tile was last accepted
+	cv::Mat _blocks;
+	cv::Mat reference;
+
+	// one byte per tile, grown is dirty dilated by one tile
+	cv::Mat _dirty;
+	cv::Mat _grown;
+
+private:
+	void blockMaxima(const cv::Mat &image, const PixelFormat format, const cv::Size size)
+	{
+		_blocks.create((size.height + BLOCK - 1) / BLOCK, (size.width + BLOCK - 1) / BLOCK, CV_8UC1);
+		_blocks.setTo(cv::Scalar(0));
+
+		for (int y = 0; y < size.height; y++)
+		{
+			const uint8_t *row = image.ptr<uint8_t>(y);
+			uint8_t *blocks = _blocks.ptr<uint8_t>(y / BLOCK);
+			for (int x = 0; x < size.width; x++)
+			{
+				uint8_t v;
+				if (format == PixelFormat::YUYV)
+					v = row[2 * x];
+				else if (format == PixelFormat::NV12)
+					v = row[x];
+				else
+					v = std::max(std::max(row[3 * x], row[3 * x + 1]), row[3 * x + 2]);
+				uint8_t &block = blocks[x / BLOCK];
+				block = std::max(block, v);
+			}
+		}
+	}
+
+	bool tileChanged(const int tx, const int ty) const
+	{
+		const int y1 = std::min((ty + 1) * BLOCKS_PER_TILE, _blocks.rows);
+		const int x1 = std::min((tx + 1) * BLOCKS_PER_TILE, _blocks.cols);
+		for (int y = ty * BLOCKS_PER_TILE; y < y1; y++)
+		{
+			const uint8_t *now = _blocks.ptr<uint8_t>(y);
+			const uint8_t *then = reference.ptr<uint8_t>(y);
+			for (int x = tx * BLOCKS_PER_TILE; x < x1; x++)
+			{
+				if (std::abs(now[x] - then[x]) > threshold)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	void acceptTile(const int tx, const int ty)
+	{
+		const cv::Rect blocks = cv::Rect(tx * BLOCKS_PER_TILE, ty * BLOCKS_PER_TILE, BLOCKS_PER_TILE, BLOCKS_PER_TILE) & cv::Rect(0, 0, _blocks.cols, _blocks.rows);
+		cv::Mat target = reference(blocks);
+		_blocks(blocks).copyTo(target);
+	}
+
+public:
+	// threshold is how much brighter or darker a block has to get to count as a change
+	ChangeMask(const int threshold = 24)
+		: threshold(threshold)
+	{
+	}
+
+	/*
+		Compares image with the reference and puts the dirty tiles in regions, one rect per
+		run of dirty tiles in a tile row, one pixel taller so runs of neighbouring rows overlap
+		and merge. False when there is no reference of this size yet, then nothing is
+		compared and accept has to be called.
+	*/
+	bool update(const cv::Mat &image, const PixelFormat format, vector<cv::Rect> &regions)
+	{
+		regions.clear();
+		const cv::Size size = YUVKernel::size(image, format);
+		blockMaxima(image, format, size);
+		if (!valid || size != frameSize)
+		{
+			frameSize = size;
+			valid = false;
+			dirtyFraction = 1.f;
+			return false;
+		}
+
+		const int tilesX = (size.width + TILE - 1) / TILE;
+		const int tilesY = (size.height + TILE - 1) / TILE;
+		_dirty.create(tilesY, tilesX, CV_8UC1);
+		_grown.create(tilesY, tilesX, CV_8UC1);
+		_grown.setTo(cv::Scalar(0));
+		for (int ty = 0; ty < tilesY; ty++)
+		{
+			for (int tx = 0; tx < tilesX; tx++)
+				_dirty.at<uint8_t>(ty, tx) = tileChanged(tx, ty);
+		}
+
+		int grown = 0;
+		for (int ty = 0; ty < tilesY; ty++)
+		{
+			for (int tx = 0; tx < tilesX; tx++)
+			{
+				if (!_dirty.at<uint8_t>(ty, tx))
+					continue;
+				for (int y = std::max(ty - 1, 0); y <= std::min(ty + 1, tilesY - 1); y++)
+				{
+					for (int x = std::max(tx - 1, 0); x <= std::min(tx + 1, tilesX - 1); x++)
+					{
+						uint8_t &g = _grown.at<uint8_t>(y, x);
+						grown += !g;
+						g = 1;
+					}
+				}
+			}
+		}
+		dirtyFraction = (float)grown / (tilesX * tilesY);
+
+		for (int ty = 0; ty < tilesY; ty++)
+		{
+			for (int tx = 0; tx < tilesX;)
+			{
+				if (!_grown.at<uint8_t>(ty, tx))
+				{
+					tx++;
+					continue;
+				}
+				const int first = tx;
+				while (tx < tilesX && _grown.at<uint8_t>(ty, tx))
+					acceptTile(tx++, ty);
+				regions.emplace_back(first * TILE, ty * TILE, (tx - first) * TILE, TILE + 1);
+			}
+		}
+		return true;
+	}
+
+	// the whole frame of the last update becomes the reference
+	void accept()
+	{
+		_blocks.copyTo(reference);
+		valid = true;
+	}
+
+	// fraction of the tiles the last update reported
+	float dirty() const
+	{
+		return dirtyFraction;
+	}
+};
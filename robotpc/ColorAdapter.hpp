@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "ColorClassifier.hpp"
+
+using std::array;
+using std::optional;
+using std::vector;
+
+/*
+	Lets the hsv range of every class follow slow changes of the light, within bounds
+	around the range it was registered with.
+
+	Pixels around blobs that are known to be an LED are sampled into one histogram per
+	channel. Pixels that fell just out of the current range are sampled too, as long as they
+	are inside the bounds, otherwise a range could only ever shrink. Once a class has
+	MIN_SAMPLES of them, every edge of its range moves RATE of the way towards a low or high
+	percentile of its histogram widened by PAD, and the histograms are halved so older light
+	fades out. Edges never move more than MAX_SHIFT from where they were registered. Classes
+	nobody samples keep their range.
+*/
+class ColorAdapter
+{
+public:
+	// how far an edge may move from where it was registered, h s v
+	inline static const array<int, 3> MAX_SHIFT = {8, 40, 40};
+
+private:
+	inline static const array<int, 3> MAX_VALUE = {179, 255, 255};
+	inline static const array<float, 3> PAD = {2.f, 10.f, 10.f};
+	inline static const float LOW_PERCENTILE = 0.02f;
+	inline static const float HIGH_PERCENTILE = 0.98f;
+	inline static const float RATE = 0.2f;
+	inline static const float MIN_SAMPLES = 400.f;
+
+	struct ClassState
+	{
+		HSVRange registered;
+		// current edges, fractional so small steps add up
+		array<float, 3> low;
+		array<float, 3> high;
+		array<array<float, 256>, 3> histograms = {};
+		float samples = 0.f;
+	};
+
+	// classes[label - 1]
+	vector<ClassState> classes;
+
+private:
+	int lowestSampled(const ClassState &c, const int channel) const
+	{
+		return std::max((int)c.registered.low[channel] - MAX_SHIFT[channel], 0);
+	}
+
+	int highestSampled(const ClassState &c, const int channel) const
+	{
+		return std::min((int)c.registered.high[channel] + MAX_SHIFT[channel], MAX_VALUE[channel]);
+	}
+
+	// value below which fraction of the samples of a channel are
+	static float percentile(const array<float, 256> &histogram, const float total, const float fraction)
+	{
+		float seen = 0.f;
+		for (int value = 0; value < 256; value++)
+		{
+			seen += histogram[value];
+			if (seen >= fraction * total)
+				return (float)value;
+		}
+		return 255.f;
+	}
+
+	static HSVRange rounded(const ClassState &c)
+	{
+		HSVRange range;
+		for (int channel = 0; channel < 3; channel++)
+		{
+			range.low[channel] = (uint8_t)std::lround(c.low[channel]);
+			range.high[channel] = (uint8_t)std::lround(c.high[channel]);
+		}
+		return range;
+	}
+
+public:
+	// label has to be the next one, 1 for the first class
+	void add(const uint8_t label, const HSVRange &range)
+	{
+		if (label != classes.size() + 1)
+			return;
+		ClassState &c = classes.emplace_back();
+		c.registered = range;
+		for (int channel = 0; channel < 3; channel++)
+		{
+			c.low[channel] = range.low[channel];
+			c.high[channel] = range.high[channel];
+		}
+	}
+
+	int classCount() const
+	{
+		return (int)classes.size();
+	}
+
+	// true when the pixel is close enough to the registered range of label to be sampled
+	bool near(const uint8_t label, const uint8_t h, const uint8_t s, const uint8_t v) const
+	{
+		const ClassState &c = classes[label - 1];
+		const uint8_t hsv[3] = {h, s, v};
+		for (int channel = 0; channel < 3; channel++)
+		{
+			if (hsv[channel] < lowestSampled(c, channel) || hsv[channel] > highestSampled(c, channel))
+				return false;
+		}
+		return true;
+	}
+
+	void sample(const uint8_t label, const uint8_t h, const uint8_t s, const uint8_t v)
+	{
+		ClassState &c = classes[label - 1];
+		c.histograms[0][h]++;
+		c.histograms[1][s]++;
+		c.histograms[2][v]++;
+		c.samples++;
+	}
+
+	// the new range of label when it has enough samples and changed, nullopt otherwise
+	optional<HSVRange> adapt(const uint8_t label)
+	{
+		ClassState &c = classes[label - 1];
+		if (c.samples < MIN_SAMPLES)
+			return std::nullopt;
+
+		const HSVRange before = rounded(c);
+		for (int channel = 0; channel < 3; channel++)
+		{
+			const array<float, 256> &histogram = c.histograms[channel];
+			const float low = percentile(histogram, c.samples, LOW_PERCENTILE) - PAD[channel];
+			const float high = percentile(histogram, c.samples, HIGH_PERCENTILE) + PAD[channel];
+
+			const float registeredLow = c.registered.low[channel];
+			const float registeredHigh = c.registered.high[channel];
+			c.low[channel] += RATE * (std::clamp(low, registeredLow - MAX_SHIFT[channel], registeredLow + MAX_SHIFT[channel]) - c.low[channel]);
+			c.high[channel] += RATE * (std::clamp(high, registeredHigh - MAX_SHIFT[channel], registeredHigh + MAX_SHIFT[channel]) - c.high[channel]);
+			c.low[channel] = std::clamp(c.low[channel], 0.f, (float)MAX_VALUE[channel]);
+			c.high[channel] = std::clamp(c.high[channel], c.low[channel], (float)MAX_VALUE[channel]);
+		}
+
+		for (array<float, 256> &histogram : c.histograms)
+		{
+			for (float &count : histogram)
+				count *= 0.5f;
+		}
+		c.samples *= 0.5f;
+
+		const HSVRange after = rounded(c);
+		if (after == before)
+			return std::nullopt;
+		return after;
+	}
+};
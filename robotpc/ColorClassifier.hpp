@@ -0,0 +1,239 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "HSVKernel.hpp"
+#include "YUVKernel.hpp"
+
+using std::array;
+using std::optional;
+using std::vector;
+
+struct HSVRange
+{
+	cv::Vec3b low;
+	cv::Vec3b high;
+
+	bool operator==(const HSVRange &other) const
+	{
+		return low == other.low && high == other.high;
+	}
+};
+
+// pixels of a class found while labeling, used to limit the blob search
+struct ClassExtent
+{
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+	int count;
+
+	void reset()
+	{
+		minX = INT_MAX;
+		minY = INT_MAX;
+		maxX = -1;
+		maxY = -1;
+		count = 0;
+	}
+
+	cv::Rect rect() const
+	{
+		return count ? cv::Rect(minX, minY, maxX - minX + 1, maxY - minY + 1) : cv::Rect();
+	}
+};
+
+/*
+	Classifies hsv pixels against many ranges at once.
+
+	For every channel and every possible channel value we keep a bitmask of the classes
+	whose range contains that value. A pixel belongs to class i when bit i is set in all
+	three masks, so one pixel costs three table lookups no matter how many ranges exist.
+
+	Labels are 1-based, 0 means the pixel matched nothing. When ranges overlap the class
+	that was added first wins.
+
+	Frames are classified straight from bgr or yuv, hsv only ever exists for the row being labeled.
+	Yuv is not classified in yuv space itself, each row goes yuv -> bgr -> hsv. A table over
+	every yuv value would take 16 MB, would have to be rebuilt whenever ColorAdapter moves a
+	range, and weighted centroids need V of hsv anyway.
+*/
+class ColorClassifier
+{
+public:
+	static constexpr int MAX_CLASSES = 64;
+	static constexpr uint8_t NO_CLASS = 0;
+
+private:
+	vector<HSVRange> ranges;
+	array<array<uint64_t, 256>, 3> channelMasks = {};
+
+	// extents[label], index 0 is unused
+	array<ClassExtent, MAX_CLASSES + 1> extents;
+
+	// hsv of the row being classified
+	vector<uint8_t> rowH;
+	vector<uint8_t> rowS;
+	vector<uint8_t> rowV;
+
+	// the row being classified converted to bgr, for yuv frames
+	vector<uint8_t> rowBGR;
+
+private:
+	// hsvRow(y) fills rowH, rowS and rowV with row y
+	template <class HSVRow>
+	void classifyRows(const cv::Size size, HSVRow hsvRow, cv::Mat &labels, cv::Mat *value)
+	{
+		labels.create(size, CV_8UC1);
+		for (ClassExtent &e : extents)
+			e.reset();
+
+		if ((int)rowH.size() < size.width)
+		{
+			rowH.resize(size.width);
+			rowS.resize(size.width);
+			rowV.resize(size.width);
+		}
+
+		for (int y = 0; y < size.height; y++)
+		{
+			hsvRow(y);
+			if (value)
+				std::copy_n(rowV.data(), size.width, value->ptr<uint8_t>(y));
+
+			uint8_t *dst = labels.ptr<uint8_t>(y);
+			for (int x = 0; x < size.width; x++)
+			{
+				const uint8_t label = classify(rowH[x], rowS[x], rowV[x]);
+				dst[x] = label;
+				if (label == NO_CLASS)
+					continue;
+
+				ClassExtent &e = extents[label];
+				e.minX = std::min(e.minX, x);
+				e.maxX = std::max(e.maxX, x);
+				e.minY = std::min(e.minY, y);
+				e.maxY = y;
+				e.count++;
+			}
+		}
+	}
+
+public:
+	// returns the label of the range, identical ranges share a label
+	optional<uint8_t> addRange(const cv::Vec3b low, const cv::Vec3b high)
+	{
+		const HSVRange range{low, high};
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			if (ranges[i] == range)
+				return uint8_t(i + 1);
+		}
+
+		if (ranges.size() >= MAX_CLASSES)
+			return std::nullopt;
+
+		const uint64_t bit = uint64_t(1) << ranges.size();
+		for (int c = 0; c < 3; c++)
+		{
+			for (int value = low[c]; value <= high[c]; value++)
+				channelMasks[c][value] |= bit;
+		}
+
+		ranges.push_back(range);
+		return uint8_t(ranges.size());
+	}
+
+	// moves the range of an existing label, the label stays what it was
+	void setRange(const uint8_t label, const cv::Vec3b low, const cv::Vec3b high)
+	{
+		const uint64_t bit = uint64_t(1) << (label - 1);
+		for (int c = 0; c < 3; c++)
+		{
+			for (int value = 0; value < 256; value++)
+			{
+				if (value >= low[c] && value <= high[c])
+					channelMasks[c][value] |= bit;
+				else
+					channelMasks[c][value] &= ~bit;
+			}
+		}
+		ranges[label - 1] = HSVRange{low, high};
+	}
+
+	int classCount() const
+	{
+		return (int)ranges.size();
+	}
+
+	const HSVRange &range(const uint8_t label) const
+	{
+		return ranges[label - 1];
+	}
+
+	const ClassExtent &extent(const uint8_t label) const
+	{
+		return extents[label];
+	}
+
+	uint8_t classify(const uint8_t h, const uint8_t s, const uint8_t v) const
+	{
+		const uint64_t mask = channelMasks[0][h] & channelMasks[1][s] & channelMasks[2][v];
+		return mask ? uint8_t(std::countr_zero(mask) + 1) : NO_CLASS;
+	}
+
+	// bgr is CV_8UC3, labels becomes CV_8UC1 of the same size
+	void classify(const cv::Mat &bgr, cv::Mat &labels)
+	{
+		classifyRows(
+			bgr.size(),
+			[&](const int y)
+			{ HSVKernel::row(bgr.ptr<uint8_t>(y), rowH.data(), rowS.data(), rowV.data(), bgr.cols); },
+			labels,
+			nullptr);
+	}
+
+	/*
+		Classifies region of an image in any PixelFormat. Yuv rows are converted to bgr one at a
+		time right before hsv, so there is never a bgr copy of the frame. labels and value (V of
+		hsv, for weighted centroids) become CV_8UC1 of the size of region.
+	*/
+	void classify(const cv::Mat &image, const PixelFormat format, const cv::Rect &region, cv::Mat &labels, cv::Mat &value)
+	{
+		value.create(region.size(), CV_8UC1);
+		if (format == PixelFormat::BGR)
+		{
+			classifyRows(
+				region.size(),
+				[&](const int y)
+				{ HSVKernel::row(image.ptr<uint8_t>(region.y + y) + 3 * region.x, rowH.data(), rowS.data(), rowV.data(), region.width); },
+				labels,
+				&value);
+			return;
+		}
+
+		// yuv pixels come in pairs that share chroma
+		const int x0 = region.x & ~1;
+		const int x1 = std::min((region.x + region.width + 1) & ~1, YUVKernel::size(image, format).width);
+		if ((int)rowBGR.size() < 3 * (x1 - x0))
+			rowBGR.resize(3 * (x1 - x0));
+
+		classifyRows(
+			region.size(),
+			[&](const int y)
+			{
+				YUVKernel::row(image, format, x0, region.y + y, x1 - x0, rowBGR.data());
+				HSVKernel::row(rowBGR.data() + 3 * (region.x - x0), rowH.data(), rowS.data(), rowV.data(), region.width);
+			},
+			labels,
+			&value);
+	}
+};
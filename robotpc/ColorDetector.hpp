@@ -0,0 +1,348 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "Assignment.hpp"
+#include "BlinkDecoder.hpp"
+#include "Config.hpp"
+#include "MarkerTracker.hpp"
+#include "RobotDetector.hpp"
+
+using std::array;
+using std::cout;
+using std::endl;
+using std::optional;
+using std::pair;
+using std::vector;
+
+/*
+	Finds robots by the front and center LEDs of the colors Config gives them.
+
+	Robots with their own front color are followed by a MarkerTracker on their front LED so
+	only small windows around them are labeled. Center colors may be shared, centers are
+	assigned to all fronts of a color at once. Robots that share both colors are told apart
+	by the blink codes of their front LEDs.
+*/
+class ColorDetector : public RobotDetector
+{
+private:
+	// how far from its center led the front led of a blinking robot may be, in pixels
+	inline static const float BLINK_FRONT_REACH = 60.f;
+
+	// how far from its front led the center led of a robot may be, in pixels
+	inline static const float CENTER_REACH = 50.f;
+
+	// a center led this many pixels away from where it was relative to the front led last frame,
+	// or this fraction further or closer than the tracked footprint, costs 1 when pairing
+	inline static const float CENTER_CONTINUITY = 10.f;
+	inline static const float CENTER_SPACING = 0.3f;
+
+	// LEDs of a robot found this many frames in a row whose center paired for less than
+	// CONFIRM_COST are certain enough to adapt the color ranges with
+	inline static const int CONFIRM_FRAMES = 10;
+	inline static const float CONFIRM_COST = 1.f;
+
+	// robots that share the same front and center colors and are told apart by blink codes
+	struct BlinkGroup
+	{
+		uint8_t front;
+		uint8_t center;
+		BlinkTracker tracker;
+		vector<BlinkRobot> robots;
+	};
+
+	// labels of the front and center colors of each uid, blinking ones included
+	vector<optional<pair<uint8_t, uint8_t>>> uidLabels;
+	vector<BlinkGroup> blinkGroups;
+
+	// uids located by their colors, per entry of uids. Fronts are found on whichever worker
+	// takes the uid, centers are assigned to all fronts at once because uids may share
+	// center colors
+	vector<uint8_t> uids;
+	vector<const Blob *> frontBlobs;
+	vector<optional<ClassLocation>> fronts;
+	vector<const Blob *> centers;
+	vector<float> centerCosts;
+	// where the center led was relative to the front led when last seen
+	vector<optional<Point2D>> centerOffsets;
+	// frames in a row each uid was found in
+	vector<int> streaks;
+
+	// scratch of pairCenters
+	Assignment assignment;
+	vector<int> _rows;
+	vector<const Blob *> _candidates;
+	vector<float> _costs;
+	vector<int> _assigned;
+
+	// follows the front LED of each uid so only small windows of the frame are searched
+	vector<MarkerTracker> trackers;
+	vector<cv::Rect> searchRegions;
+
+	// frames since the whole frame was last searched for lost robots
+	int sinceFullScan = 0;
+
+private:
+	// what pairing center blob with the front led of entry i of uids costs
+	float pairCost(const int i, const Blob &center) const
+	{
+		const Point2D offset = center.centroid - fronts[i].value().pixel;
+		const float length = std::hypot(offset.x, offset.y);
+		if (length > CENTER_REACH)
+			return Assignment::INFEASIBLE;
+
+		const optional<float> footprint = trackers[uids[i]].footprintPixels();
+		const optional<Point2D> &last = centerOffsets[i];
+		if (!footprint && !last)
+			return length * length / (CENTER_REACH * CENTER_REACH);
+
+		float cost = 0.f;
+		if (footprint)
+		{
+			const float spacing = (length - footprint.value()) / (CENTER_SPACING * footprint.value());
+			cost += spacing * spacing;
+		}
+		if (last)
+		{
+			const Point2D moved = offset - last.value();
+			cost += (moved.x * moved.x + moved.y * moved.y) / (CENTER_CONTINUITY * CENTER_CONTINUITY);
+		}
+		return cost;
+	}
+
+	/*
+		Gives every front that was found the center blob that suits it best, for all fronts
+		whose uids share a center color at once. Taking the nearest center for each front on its
+		own fails as soon as two robots with the same center color come close, the second one
+		gets the center of the first. Costs are how far the spacing is from the tracked
+		footprint and how far the center moved relative to the front since last frame.
+	*/
+	void pairCenters(const Locator &l)
+	{
+		std::fill(centers.begin(), centers.end(), nullptr);
+
+		array<bool, ColorClassifier::MAX_CLASSES + 1> paired = {};
+		for (size_t first = 0; first < uids.size(); first++)
+		{
+			const uint8_t label = uidLabels[uids[first]].value().second;
+			if (paired[label])
+				continue;
+			paired[label] = true;
+
+			_rows.clear();
+			for (size_t i = first; i < uids.size(); i++)
+			{
+				if (fronts[i] && uidLabels[uids[i]].value().second == label)
+					_rows.push_back((int)i);
+			}
+
+			// only blobs some front can reach are worth a column
+			_candidates.clear();
+			for (const Blob &blob : l.blobs(label))
+			{
+				const bool reachable = std::any_of(_rows.begin(), _rows.end(), [&](const int i)
+												   {
+					const Point2D offset = blob.centroid - fronts[i].value().pixel;
+					return std::hypot(offset.x, offset.y) <= CENTER_REACH; });
+				if (reachable)
+					_candidates.push_back(&blob);
+			}
+
+			_costs.resize(_rows.size() * _candidates.size());
+			for (size_t r = 0; r < _rows.size(); r++)
+			{
+				for (size_t col = 0; col < _candidates.size(); col++)
+					_costs[r * _candidates.size() + col] = pairCost(_rows[r], *_candidates[col]);
+			}
+
+			assignment.solve(_costs, (int)_rows.size(), (int)_candidates.size(), _assigned);
+			for (size_t r = 0; r < _rows.size(); r++)
+			{
+				if (_assigned[r] < 0)
+					continue;
+				centers[_rows[r]] = _candidates[_assigned[r]];
+				centerCosts[_rows[r]] = _costs[r * _candidates.size() + _assigned[r]];
+			}
+		}
+	}
+
+public:
+	// registers the colors of every robot of Config with l
+	ColorDetector(Locator &l)
+		: uidLabels(Config::maxRobotCount()),
+		  trackers(Config::maxRobotCount())
+	{
+		for (int uid = 0; uid < Config::maxRobotCount(); uid++)
+		{
+			optional<RobotLEDColors> colors = Config::getColors((uint8_t)uid);
+			if (!colors)
+				continue;
+
+			const optional<uint8_t> front = l.registerColor(colors.value().frontLow, colors.value().frontHigh);
+			const optional<uint8_t> center = l.registerColor(colors.value().centerLow, colors.value().centerHigh);
+			if (!front || !center)
+			{
+				cout << "Too many colors, cannot locate uid: " << uid << endl;
+				continue;
+			}
+			uidLabels[uid] = std::make_pair(front.value(), center.value());
+			if (colors.value().blinkLength == 0)
+			{
+				uids.push_back((uint8_t)uid);
+				frontBlobs.push_back(nullptr);
+				fronts.emplace_back();
+				centers.push_back(nullptr);
+				centerCosts.push_back(0.f);
+				centerOffsets.emplace_back();
+				streaks.push_back(0);
+				continue;
+			}
+
+			auto group = std::find_if(blinkGroups.begin(), blinkGroups.end(), [&](const BlinkGroup &g)
+									  { return g.front == front.value() && g.center == center.value(); });
+			if (group == blinkGroups.end())
+			{
+				blinkGroups.push_back({.front = front.value(), .center = center.value(), .tracker = BlinkTracker(Config::blinkBitSeconds())});
+				group = blinkGroups.end() - 1;
+			}
+			if (!group->tracker.addCode(colors.value().blinkBits, colors.value().blinkLength, (uint8_t)uid))
+				cout << "Blink code of uid " << uid << " is the same as another one, cannot locate it" << endl;
+		}
+	}
+
+	string name() const override
+	{
+		return "color";
+	}
+
+	// the robots of Config with the color ranges l classifies with now
+	bool exportSettings(const Locator &l, const string &path) const override
+	{
+		vector<RobotLEDColors> robots;
+		for (int uid = 0; uid < Config::maxRobotCount(); uid++)
+		{
+			RobotLEDColors colors = Config::getColors((uint8_t)uid).value();
+			if (uidLabels[uid])
+			{
+				const HSVRange &front = l.colorRange(uidLabels[uid].value().first);
+				const HSVRange &center = l.colorRange(uidLabels[uid].value().second);
+				colors.frontLow = front.low;
+				colors.frontHigh = front.high;
+				colors.centerLow = center.low;
+				colors.centerHigh = center.high;
+			}
+			robots.push_back(colors);
+		}
+		return Config::save(path, robots);
+	}
+
+	void detect(Locator &l, const QualityLevel &quality, vector<RobotObservation> &robots) override
+	{
+		robots.clear();
+
+		// blinking robots can be anywhere in the frame, nothing tracks them by uid yet
+		const bool blinking = !blinkGroups.empty();
+		bool lost = false;
+		searchRegions.clear();
+		for (const uint8_t uid : uids)
+		{
+			const optional<cv::Rect> window = trackers[uid].searchWindow(l.frameTime(), l.frameSize(), quality.windowScale);
+			if (window)
+				searchRegions.push_back(window.value());
+			else
+				lost = true;
+		}
+
+		// lost robots wait for the next full scan, the windows of tracked robots are labeled even where nothing changed
+		sinceFullScan++;
+		if (blinking || (lost && sinceFullScan >= quality.fullScanEvery))
+		{
+			sinceFullScan = 0;
+			l.labelChanges(searchRegions);
+		}
+		else
+		{
+			l.labelRegions(searchRegions);
+		}
+
+		l.workers().run((int)uids.size(), [&](const int, const int i)
+						{
+			const uint8_t uid = uids[i];
+			optional<RegionOfInterest> frontROI = std::nullopt;
+			if (const optional<cv::Rect> window = trackers[uid].searchWindow(l.frameTime(), l.frameSize(), quality.windowScale))
+				frontROI = RegionOfInterest(window.value());
+			frontBlobs[i] = l.findClass(uidLabels[uid].value().first, frontROI);
+			fronts[i] = frontBlobs[i] ? l.locateBlob(*frontBlobs[i], 0.f) : std::nullopt; });
+
+		pairCenters(l);
+
+		for (size_t i = 0; i < uids.size(); i++)
+		{
+			const uint8_t uid = uids[i];
+			MarkerTracker &tracker = trackers[uid];
+			const optional<ClassLocation> center = centers[i] ? l.locateBlob(*centers[i], 0.f) : std::nullopt;
+			if (!fronts[i] || !center)
+			{
+				tracker.miss();
+				if (tracker.lost())
+					centerOffsets[i] = std::nullopt;
+				streaks[i] = 0;
+				continue;
+			}
+
+			const ClassLocation &front = fronts[i].value();
+			const Point2D footprint = center.value().pixel - front.pixel;
+			tracker.hit(front.pixel, std::hypot(footprint.x, footprint.y), l.frameTime());
+			centerOffsets[i] = footprint;
+
+			// colors only adapt to LEDs nothing else could have been
+			if (++streaks[i] >= CONFIRM_FRAMES && centerCosts[i] < CONFIRM_COST)
+			{
+				l.sampleBlob(uidLabels[uid].value().first, *frontBlobs[i]);
+				l.sampleBlob(uidLabels[uid].value().second, *centers[i]);
+			}
+
+			robots.push_back({
+				.uid = uid,
+				.center = center.value().world,
+				.front = front.world,
+				.centerPixel = center.value().pixel,
+				.frontPixel = front.pixel,
+			});
+		}
+
+		l.adaptColors();
+
+		// blink groups only read the blobs, projecting what they found uses the locator so it waits until all of them are done
+		l.workers().run((int)blinkGroups.size(), [&](const int, const int i)
+						{
+			BlinkGroup &group = blinkGroups[i];
+			group.tracker.update(l.frameTime(), l.blobs(group.center), l.blobs(group.front), BLINK_FRONT_REACH);
+			group.tracker.robots(group.robots); });
+
+		for (const BlinkGroup &group : blinkGroups)
+		{
+			for (const BlinkRobot &robot : group.robots)
+			{
+				const Point2D pixels[2] = {robot.centerPixel, robot.frontPixel};
+				Point3D world[2];
+				if (l.pixelsToFloor(pixels, world) < 2)
+					continue;
+
+				robots.push_back({
+					.uid = robot.uid,
+					.center = world[0],
+					.front = world[1],
+					.centerPixel = robot.centerPixel,
+					.frontPixel = robot.frontPixel,
+				});
+			}
+		}
+	}
+};
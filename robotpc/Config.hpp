@@ -5,11 +5,17 @@
 #include <map>
 #include <vector>
 #include <optional>
+#include <iostream>
+#include <string>
 
 #include "Messages.hpp"
+#include "BlinkDecoder.hpp"
 
+using std::cout;
+using std::endl;
 using std::map;
 using std::optional;
+using std::string;
 using std::vector;
 
 struct RobotLEDColors
@@ -26,6 +32,10 @@ struct RobotLEDColors
 
 	cv::Vec3b frontLow;
 	cv::Vec3b frontHigh;
+
+	// the front led blinks this code when blinkLength > 0, robots that share colors are then told apart by it
+	uint32_t blinkBits = 0;
+	uint8_t blinkLength = 0;
 };
 
 class Config
@@ -49,12 +59,214 @@ private:
 		}
 	};
 
+	// what load read, the vector above until then
+	static inline vector<RobotLEDColors> robots = UID_TO_ROBOT_COLORS_VECTOR;
+	static inline float bitSeconds = 0.1f;
+
+private:
+	static LEDData readLED(const cv::FileNode &node)
+	{
+		const string order = (string)node["order"];
+		return LEDData(
+			(int)node["gpio"],
+			(uint8_t)(int)node["rgb"][0],
+			(uint8_t)(int)node["rgb"][1],
+			(uint8_t)(int)node["rgb"][2],
+			order == "GRB" ? ColorOrder::GRB : ColorOrder::RGB);
+	}
+
+	// low h, s, v then high h, s, v
+	static bool readRange(const cv::FileNode &node, cv::Vec3b &low, cv::Vec3b &high)
+	{
+		if (node.size() != 6)
+			return false;
+		low = cv::Vec3b((uint8_t)(int)node[0], (uint8_t)(int)node[1], (uint8_t)(int)node[2]);
+		high = cv::Vec3b((uint8_t)(int)node[3], (uint8_t)(int)node[4], (uint8_t)(int)node[5]);
+		return true;
+	}
+
+	static void writeLED(cv::FileStorage &file, const LEDData &led)
+	{
+		file << "{" << "gpio" << (int)led.gpio_num;
+		file << "rgb" << "[:" << (int)led.r << (int)led.g << (int)led.b << "]";
+		file << "order" << (led.colorOrder == ColorOrder::GRB ? "GRB" : "RGB") << "}";
+	}
+
+	static void writeRange(cv::FileStorage &file, const cv::Vec3b low, const cv::Vec3b high)
+	{
+		file << "[:" << (int)low[0] << (int)low[1] << (int)low[2] << (int)high[0] << (int)high[1] << (int)high[2] << "]";
+	}
+
 public:
+	static bool sameColors(const RobotLEDColors &a, const RobotLEDColors &b)
+	{
+		return a.centerLow == b.centerLow && a.centerHigh == b.centerHigh && a.frontLow == b.frontLow && a.frontHigh == b.frontHigh;
+	}
+
+	/*
+		Reads the robots from a file like robots.yaml, uids are the order they are listed in.
+		Robots with blinkLength but no blinkBits get the next code nobody with the same colors
+		uses. Has to run before anything asks for colors, on failure the previous robots stay.
+	*/
+	static bool load(const string &path)
+	{
+		cv::FileStorage file;
+		try
+		{
+			if (!file.open(path, cv::FileStorage::READ))
+			{
+				cout << "Cannot open " << path << endl;
+				return false;
+			}
+		}
+		catch (const cv::Exception &e)
+		{
+			cout << "Cannot parse " << path << ": " << e.what() << endl;
+			return false;
+		}
+
+		const cv::FileNode list = file["robots"];
+		if (!list.isSeq() || list.size() == 0 || list.size() > 256)
+		{
+			cout << path << ": robots must be a list of 1 to 256 entries" << endl;
+			return false;
+		}
+
+		vector<RobotLEDColors> loaded;
+		for (const cv::FileNode &node : list)
+		{
+			RobotLEDColors robot;
+			robot.center = readLED(node["centerLED"]);
+			robot.front = readLED(node["frontLED"]);
+			if (!readRange(node["centerHSV"], robot.centerLow, robot.centerHigh) || !readRange(node["frontHSV"], robot.frontLow, robot.frontHigh))
+			{
+				cout << path << ": robot " << loaded.size() << " needs centerHSV and frontHSV with 6 values" << endl;
+				return false;
+			}
+			robot.blinkLength = node["blinkLength"].empty() ? 0 : (uint8_t)(int)node["blinkLength"];
+			robot.blinkBits = node["blinkBits"].empty() ? 0 : (uint32_t)(int)node["blinkBits"];
+			if (robot.blinkLength > BlinkCodes::MAX_LENGTH)
+			{
+				cout << path << ": robot " << loaded.size() << " blinkLength is more than " << BlinkCodes::MAX_LENGTH << endl;
+				return false;
+			}
+			if ((uint64_t)robot.blinkBits >> robot.blinkLength != 0)
+			{
+				cout << path << ": robot " << loaded.size() << " blinkBits has bits beyond blinkLength" << endl;
+				return false;
+			}
+			loaded.push_back(robot);
+		}
+
+		// codes only have to differ between robots that look the same
+		for (size_t i = 0; i < loaded.size(); i++)
+		{
+			RobotLEDColors &robot = loaded[i];
+			if (robot.blinkLength == 0 || robot.blinkBits != 0)
+				continue;
+			for (int n = 0; robot.blinkBits == 0; n++)
+			{
+				const optional<uint32_t> code = BlinkCodes::nth(n, robot.blinkLength);
+				if (!code)
+				{
+					cout << path << ": not enough codes of length " << (int)robot.blinkLength << " for robot " << i << endl;
+					return false;
+				}
+
+				bool used = false;
+				for (size_t j = 0; j < loaded.size() && !used; j++)
+				{
+					const RobotLEDColors &other = loaded[j];
+					used = j != i && other.blinkLength == robot.blinkLength && other.blinkBits != 0 && sameColors(robot, other) &&
+						   BlinkCodes::canonical(other.blinkBits, other.blinkLength) == code.value();
+				}
+				if (!used)
+					robot.blinkBits = code.value();
+			}
+		}
+
+		// only the largest blob of a color near a robot is taken, a robot that does not blink has
+		// nothing but its front color to be found by
+		for (size_t i = 0; i < loaded.size(); i++)
+		{
+			for (size_t j = 0; j < loaded.size(); j++)
+			{
+				const RobotLEDColors &a = loaded[i];
+				const RobotLEDColors &b = loaded[j];
+				if (j != i && a.blinkLength == 0 && (sameColors(a, b) || (a.frontLow == b.frontLow && a.frontHigh == b.frontHigh)))
+				{
+					cout << path << ": robot " << i << " does not blink and has the front color of robot " << j << endl;
+					return false;
+				}
+			}
+		}
+
+		// a code is only known up to rotation, robots that look the same and blink rotations of one code cannot be told apart
+		for (size_t i = 0; i < loaded.size(); i++)
+		{
+			for (size_t j = i + 1; j < loaded.size(); j++)
+			{
+				const RobotLEDColors &a = loaded[i];
+				const RobotLEDColors &b = loaded[j];
+				if (a.blinkLength > 0 && a.blinkLength == b.blinkLength && sameColors(a, b) &&
+					BlinkCodes::canonical(a.blinkBits, a.blinkLength) == BlinkCodes::canonical(b.blinkBits, b.blinkLength))
+				{
+					cout << path << ": robots " << i << " and " << j << " have the same colors and their blink codes are rotations of each other" << endl;
+					return false;
+				}
+			}
+		}
+
+		if (!file["blinkBitSeconds"].empty())
+			bitSeconds = (float)file["blinkBitSeconds"];
+		robots = loaded;
+		return true;
+	}
+
+	// writes robots to a file load can read, blink codes are written out even where load picked them
+	static bool save(const string &path, const vector<RobotLEDColors> &robots)
+	{
+		cv::FileStorage file;
+		try
+		{
+			if (!file.open(path, cv::FileStorage::WRITE))
+			{
+				cout << "Cannot write " << path << endl;
+				return false;
+			}
+
+			file << "blinkBitSeconds" << bitSeconds;
+			file << "robots" << "[";
+			for (const RobotLEDColors &robot : robots)
+			{
+				file << "{";
+				file << "centerLED";
+				writeLED(file, robot.center);
+				file << "frontLED";
+				writeLED(file, robot.front);
+				file << "centerHSV";
+				writeRange(file, robot.centerLow, robot.centerHigh);
+				file << "frontHSV";
+				writeRange(file, robot.frontLow, robot.frontHigh);
+				if (robot.blinkLength > 0)
+					file << "blinkLength" << (int)robot.blinkLength << "blinkBits" << (int)robot.blinkBits;
+				file << "}";
+			}
+			file << "]";
+		}
+		catch (const cv::Exception &e)
+		{
+			cout << "Cannot write " << path << ": " << e.what() << endl;
+			return false;
+		}
+		return true;
+	}
+
 	static const optional<RobotLEDColors> getColors(const uint8_t uid)
 	{
 		try
 		{
-			return UID_TO_ROBOT_COLORS_VECTOR[uid];
+			return robots.at(uid);
 		}
 		catch (std::out_of_range &)
 		{
@@ -64,6 +276,12 @@ public:
 
 	static const int maxRobotCount()
 	{
-		return UID_TO_ROBOT_COLORS_VECTOR.size();
+		return robots.size();
+	}
+
+	// how long a blinking front led shows each bit of its code
+	static float blinkBitSeconds()
+	{
+		return bitSeconds;
 	}
 };
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+
+#include "YUVKernel.hpp"
+
+/*
+	Shrinks a region of an image by keeping the brightest pixel (largest of b, g, r, or luma
+	for yuv) of every factor x factor block. Averaging would blend a small LED with the dark
+	floor around it until it no longer matches its color range, picking a real pixel keeps
+	its color. Blocks on the right and bottom edges may be partial. The result is always bgr.
+
+	Source rows are walked once with a pointer, only the luma bytes of yuv are read, and only
+	the winning pixel of each block is converted to bgr.
+*/
+class Downsample
+{
+private:
+	template <PixelFormat FORMAT>
+	static int brightness(const uint8_t *row, const int x)
+	{
+		if constexpr (FORMAT == PixelFormat::YUYV)
+			return row[2 * x];
+		else if constexpr (FORMAT == PixelFormat::NV12)
+			return row[x];
+		else
+			return std::max(std::max(row[3 * x], row[3 * x + 1]), row[3 * x + 2]);
+	}
+
+	// the brightest pixel of a block with its place in the block below it, 255 - (dy * factor + dx)
+	// so the first of equally bright pixels is the largest key, factor is at most 15 so it fits
+	template <PixelFormat FORMAT>
+	static void scan(const cv::Mat &image, const cv::Rect &region, const int factor, cv::Mat &out)
+	{
+		const int cols = out.cols;
+		for (int y = 0; y < out.rows; y++)
+		{
+			const int y0 = region.y + y * factor;
+			const int y1 = std::min(y0 + factor, region.y + region.height);
+			uint8_t *dst = out.ptr<uint8_t>(y);
+
+			// keys are kept in the first two bytes of every output pixel until the row of blocks is done
+			for (int x = 0; x < cols; x++)
+			{
+				dst[3 * x] = 0;
+				dst[3 * x + 1] = 0;
+			}
+			for (int yy = y0; yy < y1; yy++)
+			{
+				const uint8_t *src = image.ptr<uint8_t>(yy);
+				const int rank = 255 - (yy - y0) * factor;
+				for (int x = 0; x < cols; x++)
+				{
+					const int x0 = region.x + x * factor;
+					const int n = std::min(factor, region.x + region.width - x0);
+					int key = dst[3 * x] << 8 | dst[3 * x + 1];
+					for (int i = 0; i < n; i++)
+						key = std::max(key, brightness<FORMAT>(src, x0 + i) << 8 | (rank - i));
+					dst[3 * x] = (uint8_t)(key >> 8);
+					dst[3 * x + 1] = (uint8_t)key;
+				}
+			}
+
+			for (int x = 0; x < cols; x++)
+			{
+				uint8_t *best = dst + 3 * x;
+				const int offset = 255 - best[1];
+				const int bestY = y0 + offset / factor;
+				const int bestX = region.x + x * factor + offset % factor;
+				const uint8_t *src = image.ptr<uint8_t>(bestY);
+				if constexpr (FORMAT == PixelFormat::YUYV)
+				{
+					const uint8_t *yuyv = src + 4 * (bestX / 2);
+					YUVKernel::single(src[2 * bestX], yuyv[1], yuyv[3], best);
+				}
+				else if constexpr (FORMAT == PixelFormat::NV12)
+				{
+					const uint8_t *chroma = image.ptr<uint8_t>(image.rows * 2 / 3 + bestY / 2) + (bestX & ~1);
+					YUVKernel::single(src[bestX], chroma[0], chroma[1], best);
+				}
+				else
+				{
+					std::copy_n(src + 3 * bestX, 3, best);
+				}
+			}
+		}
+	}
+
+public:
+	static void brightest(const cv::Mat &image, const PixelFormat format, const cv::Rect &region, const int factor, cv::Mat &out)
+	{
+		const int cols = (region.width + factor - 1) / factor;
+		const int rows = (region.height + factor - 1) / factor;
+		out.create(rows, cols, CV_8UC3);
+
+		if (format == PixelFormat::YUYV)
+			scan<PixelFormat::YUYV>(image, region, factor, out);
+		else if (format == PixelFormat::NV12)
+			scan<PixelFormat::NV12>(image, region, factor, out);
+		else
+			scan<PixelFormat::BGR>(image, region, factor, out);
+	}
+};
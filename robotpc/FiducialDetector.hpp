@@ -0,0 +1,385 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "Config.hpp"
+#include "RobotDetector.hpp"
+
+using std::array;
+using std::optional;
+using std::pair;
+using std::unique_ptr;
+using std::vector;
+
+/*
+	Square markers of BITS x BITS cells inside a black border one cell wide, printed on white
+	paper with at least one more cell of white around it. Cell (r, c) is bit
+	BITS * BITS - 1 - (r * BITS + c) of the code, white is 1.
+
+	Codes are picked once, in order, so that every rotation of a code is at least
+	MIN_DISTANCE bits from every rotation of every other code and from its own other
+	rotations. A marker read with up to (MIN_DISTANCE - 1) / 2 wrong bits still gives its
+	code and which way it is turned. Marker n is uid n.
+*/
+class FiducialCodes
+{
+public:
+	inline static const int BITS = 4;
+	inline static const int MIN_DISTANCE = 5;
+
+private:
+	inline static const int WORDS = 1 << (BITS * BITS);
+
+	static int distance(const uint32_t a, const uint32_t b)
+	{
+		return std::popcount(a ^ b);
+	}
+
+	static const vector<uint16_t> &table()
+	{
+		static const vector<uint16_t> codes = []()
+		{
+			vector<uint16_t> picked;
+			for (uint32_t word = 0; word < WORDS && picked.size() < 256; word++)
+			{
+				// solid squares are what every dark blob looks like
+				if (distance(word, 0) < MIN_DISTANCE || distance(word, WORDS - 1) < MIN_DISTANCE)
+					continue;
+
+				bool apart = true;
+				uint16_t turned = (uint16_t)word;
+				for (int quarter = 0; quarter < 4 && apart; quarter++)
+				{
+					if (quarter > 0 && distance(turned, word) < MIN_DISTANCE)
+						apart = false;
+					for (const uint16_t code : picked)
+						apart = apart && distance(turned, code) >= MIN_DISTANCE;
+					turned = rotate(turned);
+				}
+				if (apart)
+					picked.push_back((uint16_t)word);
+			}
+			return picked;
+		}();
+		return codes;
+	}
+
+	// id * 4 + quarter turns of every word close enough to a code, -1 for the others
+	static const vector<int16_t> &decoder()
+	{
+		static const vector<int16_t> words = []()
+		{
+			vector<int16_t> found(WORDS, -1);
+			const int reach = (MIN_DISTANCE - 1) / 2;
+			const vector<uint16_t> &codes = table();
+			for (size_t id = 0; id < codes.size(); id++)
+			{
+				uint16_t turned = codes[id];
+				for (int quarter = 0; quarter < 4; quarter++)
+				{
+					for (uint32_t error = 0; error < WORDS; error++)
+					{
+						if (std::popcount(error) <= reach)
+							found[turned ^ error] = (int16_t)(id * 4 + quarter);
+					}
+					turned = rotate(turned);
+				}
+			}
+			return found;
+		}();
+		return words;
+	}
+
+public:
+	// the code as it looks turned a quarter clockwise
+	static uint16_t rotate(const uint16_t code)
+	{
+		uint16_t turned = 0;
+		for (int r = 0; r < BITS; r++)
+		{
+			for (int c = 0; c < BITS; c++)
+			{
+				const int from = BITS * BITS - 1 - ((BITS - 1 - c) * BITS + r);
+				if (code & (1u << from))
+					turned |= (uint16_t)(1u << (BITS * BITS - 1 - (r * BITS + c)));
+			}
+		}
+		return turned;
+	}
+
+	static int count()
+	{
+		return (int)table().size();
+	}
+
+	static uint16_t code(const int id)
+	{
+		return table()[id];
+	}
+
+	// id of the code bits were read from and how many quarters clockwise it was turned
+	static optional<pair<int, int>> decode(const uint16_t bits)
+	{
+		const int16_t found = decoder()[bits];
+		if (found < 0)
+			return std::nullopt;
+		return pair<int, int>(found / 4, found % 4);
+	}
+
+	// marker id to print, cellPixels on a side per cell, white margin included
+	static cv::Mat image(const int id, const int cellPixels)
+	{
+		const int cells = BITS + 4;
+		cv::Mat marker(cells * cellPixels, cells * cellPixels, CV_8UC1, cv::Scalar(255));
+		cv::rectangle(marker, cv::Rect(cellPixels, cellPixels, (BITS + 2) * cellPixels, (BITS + 2) * cellPixels), cv::Scalar(0), cv::FILLED);
+		const uint16_t bits = code(id);
+		for (int r = 0; r < BITS; r++)
+		{
+			for (int c = 0; c < BITS; c++)
+			{
+				if (bits & (1u << (BITS * BITS - 1 - (r * BITS + c))))
+					cv::rectangle(marker, cv::Rect((c + 2) * cellPixels, (r + 2) * cellPixels, cellPixels, cellPixels), cv::Scalar(255), cv::FILLED);
+			}
+		}
+		return marker;
+	}
+};
+
+/*
+	Finds robots by one FiducialCodes marker each, lying flat on top of the robot with the
+	top edge of the marker towards its front. A marker gives identity and heading at once,
+	without any color and with a locally adaptive threshold, so it does not care much about
+	the light.
+
+	Dark regions of the adaptively thresholded gray frame whose outline is a convex
+	quadrilateral are candidate markers. Their corners are refined at full resolution and
+	each candidate is unwarped to a square of CELL_PIXELS cells and read by whichever worker
+	takes it. The border has to be dark, bits are split halfway between the border and the
+	brightest cell. When a uid is read more than once the read with fewer corrected bits wins.
+
+	Candidates are searched at half resolution unless quality asks for DetectionMode::FULL.
+*/
+class FiducialDetector : public RobotDetector
+{
+private:
+	inline static const int CELL_PIXELS = 6;
+	inline static const int CELLS = FiducialCodes::BITS + 2;
+
+	// outlines shorter than this on the frame candidates are searched in are not markers
+	inline static const double MIN_PERIMETER = 48.;
+
+	// brightest cell minus the border, less is not a printed marker
+	inline static const float MIN_CONTRAST = 30.f;
+
+	inline static const int THRESHOLD_BLOCK = 15;
+	inline static const double THRESHOLD_OFFSET = 7.;
+
+	struct Candidate
+	{
+		array<cv::Point2f, 4> corners;
+		double area;
+	};
+
+	struct Marker
+	{
+		int id;
+		int errors;
+		double area;
+		Point2D center;
+		Point2D front;
+	};
+
+	struct Worker
+	{
+		vector<cv::Point2f> corners;
+		cv::Mat warped;
+	};
+
+	cv::Mat _gray;
+	cv::Mat _small;
+	cv::Mat _binary;
+	vector<vector<cv::Point>> _contours;
+	vector<cv::Point> _polygon;
+	vector<Candidate> _candidates;
+	vector<optional<Marker>> _markers;
+	vector<unique_ptr<Worker>> workers;
+	array<int, 256> best;
+
+private:
+	static Point2D intersect(const cv::Point2f a0, const cv::Point2f a1, const cv::Point2f b0, const cv::Point2f b1)
+	{
+		const cv::Point2f a = a1 - a0;
+		const cv::Point2f b = b1 - b0;
+		const float cross = a.x * b.y - a.y * b.x;
+		if (std::abs(cross) < 1e-6f)
+			return Point2D((a0.x + a1.x) * 0.5f, (a0.y + a1.y) * 0.5f);
+		const cv::Point2f d = b0 - a0;
+		const float t = (d.x * b.y - d.y * b.x) / cross;
+		return Point2D(a0.x + a.x * t, a0.y + a.y * t);
+	}
+
+	// dark convex quadrilaterals, corners clockwise in pixels of the full frame
+	void findCandidates(const int scale)
+	{
+		const cv::Mat *search = &_gray;
+		if (scale > 1)
+		{
+			cv::resize(_gray, _small, cv::Size(), 1. / scale, 1. / scale, cv::INTER_AREA);
+			search = &_small;
+		}
+		cv::adaptiveThreshold(*search, _binary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, THRESHOLD_BLOCK, THRESHOLD_OFFSET);
+		cv::findContours(_binary, _contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+
+		_candidates.clear();
+		for (const vector<cv::Point> &contour : _contours)
+		{
+			const double perimeter = cv::arcLength(contour, true);
+			if (perimeter < MIN_PERIMETER)
+				continue;
+			cv::approxPolyDP(contour, _polygon, 0.05 * perimeter, true);
+			if (_polygon.size() != 4 || !cv::isContourConvex(_polygon))
+				continue;
+
+			Candidate candidate;
+			double signedArea = 0.;
+			for (int i = 0; i < 4; i++)
+			{
+				const cv::Point &p = _polygon[i];
+				const cv::Point &q = _polygon[(i + 1) % 4];
+				signedArea += (double)p.x * q.y - (double)q.x * p.y;
+				candidate.corners[i] = cv::Point2f((p.x + 0.5f) * scale - 0.5f, (p.y + 0.5f) * scale - 0.5f);
+			}
+			// clockwise on screen, y points down
+			if (signedArea < 0.)
+				std::swap(candidate.corners[1], candidate.corners[3]);
+			candidate.area = std::abs(signedArea) * 0.5 * scale * scale;
+			_candidates.push_back(candidate);
+		}
+	}
+
+	optional<Marker> read(Worker &w, const Candidate &candidate) const
+	{
+		w.corners.assign(candidate.corners.begin(), candidate.corners.end());
+		cv::cornerSubPix(_gray, w.corners, cv::Size(3, 3), cv::Size(-1, -1), cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 10, 0.05));
+
+		const float side = (float)(CELLS * CELL_PIXELS);
+		const cv::Point2f square[4] = {{0.f, 0.f}, {side, 0.f}, {side, side}, {0.f, side}};
+		const cv::Mat toSquare = cv::getPerspectiveTransform(w.corners.data(), square);
+		cv::warpPerspective(_gray, w.warped, toSquare, cv::Size((int)side, (int)side));
+
+		// inner pixels of every cell, edges blur into their neighbours
+		array<array<float, CELLS>, CELLS> cells;
+		for (int r = 0; r < CELLS; r++)
+		{
+			for (int c = 0; c < CELLS; c++)
+				cells[r][c] = (float)cv::mean(w.warped(cv::Rect(c * CELL_PIXELS + 1, r * CELL_PIXELS + 1, CELL_PIXELS - 2, CELL_PIXELS - 2)))[0];
+		}
+
+		float border = 0.f;
+		float brightest = 0.f;
+		for (int r = 0; r < CELLS; r++)
+		{
+			for (int c = 0; c < CELLS; c++)
+			{
+				if (r == 0 || c == 0 || r == CELLS - 1 || c == CELLS - 1)
+					border += cells[r][c];
+				else
+					brightest = std::max(brightest, cells[r][c]);
+			}
+		}
+		border /= 4 * (CELLS - 1);
+		if (brightest - border < MIN_CONTRAST)
+			return std::nullopt;
+
+		const float threshold = (border + brightest) * 0.5f;
+		for (int i = 0; i < CELLS; i++)
+		{
+			if (cells[0][i] > threshold || cells[CELLS - 1][i] > threshold || cells[i][0] > threshold || cells[i][CELLS - 1] > threshold)
+				return std::nullopt;
+		}
+
+		uint16_t bits = 0;
+		for (int r = 0; r < FiducialCodes::BITS; r++)
+		{
+			for (int c = 0; c < FiducialCodes::BITS; c++)
+				bits = (uint16_t)((bits << 1) | (cells[r + 1][c + 1] > threshold ? 1u : 0u));
+		}
+		const optional<pair<int, int>> decoded = FiducialCodes::decode(bits);
+		if (!decoded)
+			return std::nullopt;
+
+		// the code was turned quarter times clockwise, so was its top edge
+		const auto [id, quarter] = decoded.value();
+		uint16_t seen = FiducialCodes::code(id);
+		for (int i = 0; i < quarter; i++)
+			seen = FiducialCodes::rotate(seen);
+
+		const cv::Point2f &a = w.corners[quarter];
+		const cv::Point2f &b = w.corners[(quarter + 1) % 4];
+		return Marker{
+			.id = id,
+			.errors = std::popcount((uint32_t)(bits ^ seen)),
+			.area = candidate.area,
+			.center = intersect(w.corners[0], w.corners[2], w.corners[1], w.corners[3]),
+			.front = Point2D((a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f),
+		};
+	}
+
+public:
+	string name() const override
+	{
+		return "fiducial";
+	}
+
+	void detect(Locator &l, const QualityLevel &quality, vector<RobotObservation> &robots) override
+	{
+		robots.clear();
+		while ((int)workers.size() < l.workers().size())
+			workers.push_back(std::make_unique<Worker>());
+
+		cv::cvtColor(l.getFrame(), _gray, cv::COLOR_BGR2GRAY);
+		findCandidates(quality.detection == DetectionMode::FULL ? 1 : 2);
+
+		_markers.assign(_candidates.size(), std::nullopt);
+		l.workers().run((int)_candidates.size(), [&](const int worker, const int i)
+						{ _markers[i] = read(*workers[worker], _candidates[i]); });
+
+		best.fill(-1);
+		for (int i = 0; i < (int)_markers.size(); i++)
+		{
+			if (!_markers[i] || _markers[i].value().id >= Config::maxRobotCount())
+				continue;
+			int &b = best[_markers[i].value().id];
+			if (b < 0 || _markers[i].value().errors < _markers[b].value().errors ||
+				(_markers[i].value().errors == _markers[b].value().errors && _markers[i].value().area > _markers[b].value().area))
+				b = i;
+		}
+
+		for (const int i : best)
+		{
+			if (i < 0)
+				continue;
+			const Marker &marker = _markers[i].value();
+			const optional<Point3D> center = l.pixelToFloor(marker.center);
+			const optional<Point3D> front = l.pixelToFloor(marker.front);
+			if (!center || !front)
+				continue;
+
+			robots.push_back({
+				.uid = (uint8_t)marker.id,
+				.center = center.value(),
+				.front = front.value(),
+				.centerPixel = marker.center,
+				.frontPixel = marker.front,
+			});
+		}
+	}
+};
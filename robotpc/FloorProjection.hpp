@@ -0,0 +1,261 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Point.hpp"
+
+using std::optional;
+using std::span;
+using std::vector;
+
+/*
+	Where a camera stands in the arena. Floor coordinates of a camera have their origin
+	right below it and y along its view, the arena frame is shared by all cameras:
+
+		arena = (x, y) + R(yaw) * camera
+*/
+struct CameraPlacement
+{
+	float x = 0.f;
+	float y = 0.f;
+	float yawDeg = 0.f;
+
+	Point3D toArena(const Point3D &camera) const
+	{
+		const float yaw = yawDeg * (float)CV_PI / 180.f;
+		const float c = std::cos(yaw);
+		const float s = std::sin(yaw);
+		return Point3D(x + c * camera.x - s * camera.y, y + s * camera.x + c * camera.y, camera.z);
+	}
+
+	Point3D toCamera(const Point3D &arena) const
+	{
+		const float yaw = yawDeg * (float)CV_PI / 180.f;
+		const float c = std::cos(yaw);
+		const float s = std::sin(yaw);
+		const float dx = arena.x - x;
+		const float dy = arena.y - y;
+		return Point3D(c * dx + s * dy, -s * dx + c * dy, arena.z);
+	}
+};
+
+/*
+	Maps pixels to points on a horizontal plane at a fixed height with one 3x3 homography
+
+		(X, Y, W) = H * (px, py, 1)	world = (X / W, Y / W, height)
+
+	A pixel is on the plane when 0 < W < maxW. Above the horizon W drops to 0 and below,
+	maxW rejects points that would lie behind the camera.
+
+	The homography is either composed from the camera model or fitted from pixels of known
+	floor points, in which case d, sw and sh do not have to be measured at all.
+*/
+class FloorProjection
+{
+private:
+	cv::Matx33f H = cv::Matx33f::eye();
+	float height = 0.f;
+	float maxW = std::numeric_limits<float>::infinity();
+
+	// the camera height, planes at other heights are scaled copies of this one
+	float zc = 0.f;
+
+public:
+	FloorProjection() = default;
+
+	/*
+		The camera model of Locator collapsed into one matrix
+
+			u = (px - width / 2) * sw	v = (height / 2 - py) * sh
+			W = d sin - v cos			(l = (zc - a) / W)
+			x = (zc - a) u / W			y = (zc - a) (d cos (1 + sin) + v sin^2) / W
+
+		so it gives exactly what pixelXYToImagePlaneUV, imagePlaneUVToImagePlaneXYZ and
+		imagePlaneXYZToFloor give one after the other.
+	*/
+	static FloorProjection fromCamera(const cv::Size imageSize, const float zc, const float theta, const float d, const float sw, const float sh, const float a = 0.f)
+	{
+		const float c = std::cos(theta);
+		const float s = std::sin(theta);
+		const float cx = imageSize.width * 0.5f;
+		const float cy = imageSize.height * 0.5f;
+		const float k = zc - a;
+
+		FloorProjection projection;
+		projection.H = cv::Matx33f(
+			k * sw, 0.f, -k * sw * cx,
+			0.f, -k * s * s * sh, k * (d * c * (1.f + s) + s * s * sh * cy),
+			0.f, c * sh, d * s - c * sh * cy);
+		projection.height = a;
+		projection.maxW = k;
+		projection.zc = zc;
+		return projection;
+	}
+
+	// least squares fit from at least 4 pixels and where they are on the plane at height a
+	static optional<FloorProjection> fit(span<const Point2D> pixels, span<const Point2D> floor, const float zc, const float a = 0.f)
+	{
+		if (pixels.size() < 4 || pixels.size() != floor.size())
+			return std::nullopt;
+
+		vector<cv::Point2f> src, dst;
+		for (size_t i = 0; i < pixels.size(); i++)
+		{
+			src.emplace_back(pixels[i].x, pixels[i].y);
+			dst.emplace_back(floor[i].x, floor[i].y);
+		}
+
+		const cv::Mat found = cv::findHomography(src, dst, 0);
+		if (found.empty())
+			return std::nullopt;
+
+		const cv::Matx33d fitted = found;
+		FloorProjection projection;
+		for (int row = 0; row < 3; row++)
+			for (int col = 0; col < 3; col++)
+				projection.H(row, col) = (float)fitted(row, col);
+		projection.height = a;
+		projection.zc = zc;
+
+		// the scale of a homography is free, pick the sign that makes W positive on the floor
+		const Point2D first = pixels[0];
+		if (projection.H(2, 0) * first.x + projection.H(2, 1) * first.y + projection.H(2, 2) < 0.f)
+			projection.H = projection.H * -1.f;
+		return projection;
+	}
+
+	// the same camera looking at a plane at height a instead
+	FloorProjection atHeight(const float a) const
+	{
+		FloorProjection projection = *this;
+		const float scale = (zc - a) / (zc - height);
+		for (int col = 0; col < 3; col++)
+		{
+			projection.H(0, col) *= scale;
+			projection.H(1, col) *= scale;
+		}
+		projection.height = a;
+		projection.maxW = maxW * scale;
+		return projection;
+	}
+
+	// the same camera delivering frames of another size, for fitted projections
+	FloorProjection resized(const cv::Size from, const cv::Size to) const
+	{
+		FloorProjection projection = *this;
+		const cv::Matx33f scale(
+			(float)from.width / to.width, 0.f, 0.f,
+			0.f, (float)from.height / to.height, 0.f,
+			0.f, 0.f, 1.f);
+		projection.H = H * scale;
+		return projection;
+	}
+
+	const cv::Matx33f &matrix() const
+	{
+		return H;
+	}
+
+	float planeHeight() const
+	{
+		return height;
+	}
+
+	optional<Point3D> project(const Point2D pixel) const
+	{
+		const float w = H(2, 0) * pixel.x + H(2, 1) * pixel.y + H(2, 2);
+		if (!(w > 0.f && w < maxW))
+			return std::nullopt;
+
+		return Point3D(
+			(H(0, 0) * pixel.x + H(0, 1) * pixel.y + H(0, 2)) / w,
+			(H(1, 0) * pixel.x + H(1, 1) * pixel.y + H(1, 2)) / w,
+			height);
+	}
+
+	// projects every pixel, the ones off the plane get NaN x and y, returns how many are on it
+	size_t project(span<const Point2D> pixels, span<Point3D> world) const
+	{
+		const size_t count = std::min(pixels.size(), world.size());
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+		size_t onPlane = 0;
+		size_t i = 0;
+
+#if defined(__AVX__)
+		const __m256 h00 = _mm256_set1_ps(H(0, 0)), h01 = _mm256_set1_ps(H(0, 1)), h02 = _mm256_set1_ps(H(0, 2));
+		const __m256 h10 = _mm256_set1_ps(H(1, 0)), h11 = _mm256_set1_ps(H(1, 1)), h12 = _mm256_set1_ps(H(1, 2));
+		const __m256 h20 = _mm256_set1_ps(H(2, 0)), h21 = _mm256_set1_ps(H(2, 1)), h22 = _mm256_set1_ps(H(2, 2));
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 limit = _mm256_set1_ps(maxW);
+		const __m256 nans = _mm256_set1_ps(nan);
+		alignas(32) float xs[8], ys[8];
+
+		for (; i + 8 <= count; i += 8)
+		{
+			// x0 y0 x1 y1 x2 y2 x3 y3 | x4 y4 ... -> x0 x1 x4 x5 x2 x3 x6 x7, same order for y
+			const __m256 a = _mm256_loadu_ps(&pixels[i].x);
+			const __m256 b = _mm256_loadu_ps(&pixels[i + 4].x);
+			const __m256 px = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m256 py = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+			const __m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h20, px), _mm256_mul_ps(h21, py)), h22);
+			const __m256 X = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h00, px), _mm256_mul_ps(h01, py)), h02);
+			const __m256 Y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h10, px), _mm256_mul_ps(h11, py)), h12);
+			const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_GT_OQ), _mm256_cmp_ps(w, limit, _CMP_LT_OQ));
+
+			_mm256_store_ps(xs, _mm256_blendv_ps(nans, _mm256_div_ps(X, w), valid));
+			_mm256_store_ps(ys, _mm256_blendv_ps(nans, _mm256_div_ps(Y, w), valid));
+			onPlane += __builtin_popcount(_mm256_movemask_ps(valid));
+
+			static constexpr int order[8] = {0, 1, 4, 5, 2, 3, 6, 7};
+			for (int k = 0; k < 8; k++)
+				world[i + k] = Point3D(xs[order[k]], ys[order[k]], height);
+		}
+#elif defined(__SSE2__)
+		const __m128 h00 = _mm_set1_ps(H(0, 0)), h01 = _mm_set1_ps(H(0, 1)), h02 = _mm_set1_ps(H(0, 2));
+		const __m128 h10 = _mm_set1_ps(H(1, 0)), h11 = _mm_set1_ps(H(1, 1)), h12 = _mm_set1_ps(H(1, 2));
+		const __m128 h20 = _mm_set1_ps(H(2, 0)), h21 = _mm_set1_ps(H(2, 1)), h22 = _mm_set1_ps(H(2, 2));
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 limit = _mm_set1_ps(maxW);
+		const __m128 nans = _mm_set1_ps(nan);
+		alignas(16) float xs[4], ys[4];
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 a = _mm_loadu_ps(&pixels[i].x);
+			const __m128 b = _mm_loadu_ps(&pixels[i + 2].x);
+			const __m128 px = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 py = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+			const __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h20, px), _mm_mul_ps(h21, py)), h22);
+			const __m128 X = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h00, px), _mm_mul_ps(h01, py)), h02);
+			const __m128 Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h10, px), _mm_mul_ps(h11, py)), h12);
+			const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(w, zero), _mm_cmplt_ps(w, limit));
+
+			_mm_store_ps(xs, _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(X, w)), _mm_andnot_ps(valid, nans)));
+			_mm_store_ps(ys, _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(Y, w)), _mm_andnot_ps(valid, nans)));
+			onPlane += __builtin_popcount(_mm_movemask_ps(valid));
+
+			for (int k = 0; k < 4; k++)
+				world[i + k] = Point3D(xs[k], ys[k], height);
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			const optional<Point3D> point = project(pixels[i]);
+			world[i] = point.value_or(Point3D(nan, nan, height));
+			onPlane += point.has_value();
+		}
+		return onPlane;
+	}
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "FrameSource.hpp"
+#include "TripleBuffer.hpp"
+
+using std::atomic;
+using std::thread;
+using std::unique_ptr;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct CaptureStats
+{
+	// frames read from the source
+	uint64_t captured;
+
+	// frames overwritten before anyone took them
+	uint64_t dropped;
+
+	// frames handed to the consumer
+	uint64_t consumed;
+
+	// time the consumer spent waiting for frames, in total and for the last frame
+	float waitSeconds;
+	float lastWaitSeconds;
+};
+
+/*
+	Reads frames from a source on its own thread so the driver blocking for the next frame
+	never stalls processing. Frames go through a triple buffer, the consumer always gets the
+	newest one and frames it was too slow to take are dropped instead of queued.
+
+	When dropped is high processing is the bottleneck, when the wait time is high capture is.
+
+	Sources that are not live, a recording played back as fast as possible, are not read
+	ahead, the capture thread waits for each frame to be taken so none are dropped.
+*/
+class FrameGrabber
+{
+private:
+	unique_ptr<FrameSource> source;
+	TripleBuffer<Frame> buffer;
+
+	thread captureThread;
+	atomic<bool> running{false};
+	atomic<bool> finished{false};
+	atomic<uint64_t> captured{0};
+	// changes for every frame and once more when the source ends, what the consumer waits on
+	atomic<uint64_t> published{0};
+	atomic<uint64_t> dropped{0};
+
+	// written by the consumer only, atomic so stats can be read from any thread
+	atomic<uint64_t> consumed{0};
+	atomic<float> waitSeconds{0.f};
+	atomic<float> lastWaitSeconds{0.f};
+
+	// bumped by the consumer for every frame it takes and by stop, sources that are not
+	// live wait on it
+	atomic<uint64_t> taken{0};
+
+	FrameGrabber(const FrameGrabber &) = delete;
+	FrameGrabber &operator=(const FrameGrabber &) = delete;
+
+private:
+	void captureLoop()
+	{
+		const bool live = source->live();
+		while (running.load())
+		{
+			if (!source->read(buffer.writeSlot()))
+				break;
+
+			if (buffer.publish())
+				dropped.fetch_add(1);
+
+			captured.fetch_add(1);
+			published.fetch_add(1);
+			published.notify_all();
+
+			while (!live && running.load())
+			{
+				const uint64_t seen = taken.load();
+				if (!buffer.hasFresh())
+					break;
+				taken.wait(seen);
+			}
+		}
+
+		// published changes too, a consumer that already read it would otherwise wait for good
+		finished.store(true);
+		published.fetch_add(1);
+		published.notify_all();
+	}
+
+public:
+	FrameGrabber(unique_ptr<FrameSource> source)
+		: source(std::move(source))
+	{
+	}
+
+	void start()
+	{
+		if (running.exchange(true))
+			return;
+		finished.store(false);
+		captureThread = thread(&FrameGrabber::captureLoop, this);
+	}
+
+	void stop()
+	{
+		running.store(false);
+		taken.fetch_add(1);
+		taken.notify_one();
+		if (captureThread.joinable())
+			captureThread.join();
+	}
+
+	// waits for a frame newer than the previous one, nullptr once the source has no more frames
+	// the frame stays valid until the next call
+	Frame *next()
+	{
+		const time_point<steady_clock> start = steady_clock::now();
+		while (true)
+		{
+			const uint64_t seen = published.load();
+			if (buffer.acquire())
+				break;
+			if (finished.load())
+				return nullptr;
+			published.wait(seen);
+		}
+
+		const float waited = duration<float>(steady_clock::now() - start).count();
+		lastWaitSeconds.store(waited);
+		waitSeconds.store(waitSeconds.load() + waited);
+		consumed.fetch_add(1);
+		taken.fetch_add(1);
+		taken.notify_one();
+		return &buffer.readSlot();
+	}
+
+	CaptureStats stats() const
+	{
+		return {
+			.captured = captured.load(),
+			.dropped = dropped.load(),
+			.consumed = consumed.load(),
+			.waitSeconds = waitSeconds.load(),
+			.lastWaitSeconds = lastWaitSeconds.load(),
+		};
+	}
+
+	~FrameGrabber()
+	{
+		stop();
+	}
+};
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "FrameSource.hpp"
+
+using std::cout;
+using std::endl;
+using std::optional;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+/*
+	Recording file layout, everything little endian as written by the machine:
+
+		FileHeader
+		RecordHeader, bytes of the frame
+		RecordHeader, bytes of the frame
+		...
+
+	Frames are stored in the format the camera sent them, yuv is 2 or 1.5 bytes per pixel and
+	mjpeg only what the camera compressed it to, nothing is converted on the way to disk.
+	Frames of the OpenCV capture backend arrive as BGR and are stored as 3 bytes per pixel,
+	about 80 MB a second at 1280x720 and 30 fps. Record from V4L2 in YUYV, NV12 or MJPEG to
+	keep files small.
+*/
+namespace recording
+{
+	inline constexpr char MAGIC[4] = {'R', 'F', 'R', 'M'};
+	inline constexpr uint32_t VERSION = 1;
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+	};
+
+	struct RecordHeader
+	{
+		// capture time relative to the first frame
+		int64_t capturedNs;
+		uint32_t format;
+		// of the stored cv::Mat, not of the frame, an mjpeg frame is one row of bytes
+		int32_t cols;
+		int32_t rows;
+		uint32_t bytes;
+	};
+
+	inline int matType(const PixelFormat format)
+	{
+		switch (format)
+		{
+		case PixelFormat::BGR:
+			return CV_8UC3;
+		case PixelFormat::YUYV:
+			return CV_8UC2;
+		default:
+			return CV_8UC1;
+		}
+	}
+}
+
+// writes frames and their capture times to a file that ReplaySource plays back
+class FrameRecorder
+{
+private:
+	std::ofstream file;
+	optional<time_point<steady_clock>> first;
+
+	void write(const void *data, const size_t bytes)
+	{
+		file.write((const char *)data, (std::streamsize)bytes);
+	}
+
+public:
+	FrameRecorder(const string &path)
+		: file(path, std::ios::binary | std::ios::trunc)
+	{
+		if (!file)
+		{
+			cout << "Cannot create " << path << endl;
+			return;
+		}
+
+		recording::FileHeader header;
+		std::memcpy(header.magic, recording::MAGIC, sizeof(header.magic));
+		header.version = recording::VERSION;
+		write(&header, sizeof(header));
+	}
+
+	bool isOpen() const
+	{
+		return file.good();
+	}
+
+	bool write(const Frame &frame)
+	{
+		if (!file)
+			return false;
+		if (!first)
+			first = frame.captured;
+
+		// frames decoded from jpeg are stored compressed as they came
+		const bool encoded = frame.encoded != nullptr;
+		const cv::Mat image = encoded ? cv::Mat(1, (int)frame.encoded->size(), CV_8UC1, (void *)frame.encoded->data()) : frame.image;
+		const size_t rowBytes = image.cols * image.elemSize();
+
+		const recording::RecordHeader header = {
+			.capturedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(frame.captured - first.value()).count(),
+			.format = (uint32_t)(encoded ? PixelFormat::MJPEG : frame.format),
+			.cols = image.cols,
+			.rows = image.rows,
+			.bytes = (uint32_t)(rowBytes * image.rows),
+		};
+		write(&header, sizeof(header));
+
+		// driver buffers may have padding at the end of each row
+		if (image.isContinuous())
+			write(image.ptr(), header.bytes);
+		else
+			for (int y = 0; y < image.rows; y++)
+				write(image.ptr(y), rowBytes);
+		return file.good();
+	}
+};
+
+// records every frame another source produces, including the ones processing drops later
+class RecordingSource : public FrameSource
+{
+private:
+	unique_ptr<FrameSource> source;
+	FrameRecorder recorder;
+	bool failed = false;
+
+public:
+	RecordingSource(unique_ptr<FrameSource> source, const string &path)
+		: source(std::move(source)),
+		  recorder(path)
+	{
+	}
+
+	bool live() const override
+	{
+		return source->live();
+	}
+
+	bool read(Frame &frame) override
+	{
+		if (!source->read(frame))
+			return false;
+
+		// a full disk should not stop the camera
+		if (!failed && !recorder.write(frame))
+		{
+			cout << "Recording stopped, cannot write frame " << frame.sequence << endl;
+			failed = true;
+		}
+		return true;
+	}
+};
+
+/*
+	Plays back a file written by FrameRecorder. The file is mmap'd and frames point into it,
+	like RawFileSource.
+
+	Paced playback sleeps so frames come out with their recorded spacing and behaves like the
+	camera did, frames that processing is too slow for get dropped. Unpaced playback hands out
+	frames as fast as they are taken and never drops any, stamped with their recorded time from
+	a fixed epoch. The same file then always gives the same frames at the same times, which
+	is what benchmarks need.
+*/
+class ReplaySource : public FrameSource
+{
+private:
+	shared_ptr<void> mapping;
+	vector<size_t> offsets;
+	bool paced;
+	optional<time_point<steady_clock>> start;
+	uint64_t sequence = 0;
+
+private:
+	const recording::RecordHeader &header(const size_t index) const
+	{
+		return *(const recording::RecordHeader *)((const uint8_t *)mapping.get() + offsets[index]);
+	}
+
+public:
+	ReplaySource(const string &path, const bool paced = true)
+		: paced(paced)
+	{
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			cout << "Cannot open " << path << endl;
+			return;
+		}
+
+		// writable and private, BGR frames are handed out as they are stored and the helper draws
+		// on them, pages it draws on are copied and the file stays as it was
+		const size_t length = (size_t)lseek(fd, 0, SEEK_END);
+		void *start = length >= sizeof(recording::FileHeader) ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (start == MAP_FAILED)
+		{
+			cout << "Cannot map " << path << endl;
+			return;
+		}
+		mapping = shared_ptr<void>(start, [length](void *p)
+								   { munmap(p, length); });
+
+		const recording::FileHeader *file = (const recording::FileHeader *)start;
+		if (std::memcmp(file->magic, recording::MAGIC, sizeof(file->magic)) != 0 || file->version != recording::VERSION)
+		{
+			cout << path << " is not a recording" << endl;
+			mapping.reset();
+			return;
+		}
+
+		// a recording cut short by a crash still plays up to its last complete frame
+		size_t offset = sizeof(recording::FileHeader);
+		while (offset + sizeof(recording::RecordHeader) <= length)
+		{
+			const recording::RecordHeader *record = (const recording::RecordHeader *)((const uint8_t *)start + offset);
+			if (offset + sizeof(recording::RecordHeader) + record->bytes > length)
+				break;
+			offsets.push_back(offset);
+			offset += sizeof(recording::RecordHeader) + record->bytes;
+		}
+	}
+
+	size_t frames() const
+	{
+		return offsets.size();
+	}
+
+	// of the first frame, MJPEG recordings have to go through MjpegDecodeSource
+	PixelFormat format() const
+	{
+		return offsets.empty() ? PixelFormat::BGR : (PixelFormat)header(0).format;
+	}
+
+	bool live() const override
+	{
+		return paced;
+	}
+
+	bool read(Frame &frame) override
+	{
+		if (sequence >= offsets.size())
+			return false;
+
+		const recording::RecordHeader &record = header(sequence);
+		const PixelFormat format = (PixelFormat)record.format;
+		if (paced)
+		{
+			if (!start)
+				start = steady_clock::now();
+			frame.captured = start.value() + std::chrono::nanoseconds(record.capturedNs);
+			std::this_thread::sleep_until(frame.captured);
+		}
+		else
+		{
+			// recorded time on a fixed epoch, trackers and blink codes then see the timing the
+			// camera had no matter how fast the file is played
+			frame.captured = time_point<steady_clock>(std::chrono::nanoseconds(record.capturedNs));
+		}
+
+		uint8_t *data = (uint8_t *)mapping.get() + offsets[sequence] + sizeof(recording::RecordHeader);
+		frame.image = cv::Mat(record.rows, record.cols, recording::matType(format), data);
+		frame.format = format;
+		frame.buffer = mapping;
+		frame.sequence = sequence++;
+		return true;
+	}
+};
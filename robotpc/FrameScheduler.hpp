@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <thread>
+
+using std::atomic;
+using std::optional;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+struct ScheduleStats
+{
+	uint64_t loops;
+
+	// loops that finished after their deadline, only counted with a target period
+	uint64_t late;
+	float lastOverrunSeconds;
+
+	// smoothed time between loop starts and how far it strays from the target
+	float periodSeconds;
+	float jitterSeconds;
+	float maxJitterSeconds;
+};
+
+/*
+	Paces the frame loop. Without a target period a loop starts as soon as a frame is ready.
+	With one, loop k may not start before slot k and has to be done one period later, slots
+	are one period apart. A loop that misses its deadline counts as late and the next slot
+	starts from when it finished, so one slow frame does not cause a burst of catch up loops.
+
+	Jitter is measured against the target period, or against the smoothed period when
+	running free.
+*/
+class FrameScheduler
+{
+private:
+	inline static const float LAMBDA = 0.1f;
+
+	const steady_clock::duration period;
+
+	// start of the current slot
+	optional<time_point<steady_clock>> slot;
+	optional<time_point<steady_clock>> lastStart;
+
+	// written by the loop thread only, atomic so stats can be read from any thread
+	atomic<uint64_t> loops{0};
+	atomic<uint64_t> late{0};
+	atomic<float> lastOverrunSeconds{0.f};
+	atomic<float> periodSeconds{0.f};
+	atomic<float> jitterSeconds{0.f};
+	atomic<float> maxJitterSeconds{0.f};
+
+	FrameScheduler(const FrameScheduler &) = delete;
+	FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+public:
+	// targetHz <= 0 runs free
+	FrameScheduler(const float targetHz = 0.f)
+		: period(targetHz > 0.f ? duration_cast<steady_clock::duration>(duration<float>(1.f / targetHz)) : steady_clock::duration::zero())
+	{
+	}
+
+	bool paced() const
+	{
+		return period > steady_clock::duration::zero();
+	}
+
+	// sleeps until the current slot starts, returns at once when running free
+	void waitForSlot() const
+	{
+		if (paced() && slot)
+			std::this_thread::sleep_until(slot.value());
+	}
+
+	// call once the frame of this loop is available
+	void begin()
+	{
+		const time_point<steady_clock> now = steady_clock::now();
+		if (!slot)
+			slot = now;
+
+		if (lastStart)
+		{
+			const float interval = duration<float>(now - lastStart.value()).count();
+			const float smoothed = periodSeconds.load() > 0.f ? interval * LAMBDA + (1.f - LAMBDA) * periodSeconds.load() : interval;
+			periodSeconds.store(smoothed);
+
+			const float target = paced() ? duration<float>(period).count() : smoothed;
+			const float jitter = std::abs(interval - target);
+			jitterSeconds.store(jitter * LAMBDA + (1.f - LAMBDA) * jitterSeconds.load());
+			maxJitterSeconds.store(std::max(maxJitterSeconds.load(), jitter));
+		}
+		lastStart = now;
+	}
+
+	// call when all work for the frame is done
+	void end()
+	{
+		loops.fetch_add(1);
+		if (!paced())
+			return;
+
+		const time_point<steady_clock> now = steady_clock::now();
+		const time_point<steady_clock> deadline = slot.value() + period;
+		if (now > deadline)
+		{
+			late.fetch_add(1);
+			lastOverrunSeconds.store(duration<float>(now - deadline).count());
+			slot = now;
+		}
+		else
+		{
+			slot = deadline;
+		}
+	}
+
+	ScheduleStats stats() const
+	{
+		return {
+			.loops = loops.load(),
+			.late = late.load(),
+			.lastOverrunSeconds = lastOverrunSeconds.load(),
+			.periodSeconds = periodSeconds.load(),
+			.jitterSeconds = jitterSeconds.load(),
+			.maxJitterSeconds = maxJitterSeconds.load(),
+		};
+	}
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/videoio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "YUVKernel.hpp"
+
+using std::shared_ptr;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+struct Frame
+{
+	cv::Mat image;
+	PixelFormat format = PixelFormat::BGR;
+
+	// keeps the memory of image alive when it belongs to someone else, a driver buffer for example
+	shared_ptr<void> buffer;
+
+	// for frames decoded from jpeg, image may be scale times smaller on each side than the
+	// frame and the full resolution pixels stay in encoded
+	shared_ptr<const vector<uint8_t>> encoded;
+	int scale = 1;
+	cv::Size fullSize;
+
+	// when the frame was captured
+	time_point<steady_clock> captured;
+
+	// increases by one for every frame the source produces
+	uint64_t sequence = 0;
+
+	cv::Size size() const
+	{
+		return scale > 1 ? fullSize : YUVKernel::size(image, format);
+	}
+};
+
+// anything that produces frames, a camera, a file, a generator...
+class FrameSource
+{
+public:
+	// blocks until the next frame is available, false when no more frames will come
+	virtual bool read(Frame &frame) = 0;
+
+	// live sources run on their own clock and frames nobody took in time are dropped,
+	// the others wait until their previous frame was taken so every frame gets processed
+	virtual bool live() const
+	{
+		return true;
+	}
+
+	virtual ~FrameSource()
+	{
+	}
+};
+
+class CameraSource : public FrameSource
+{
+private:
+	cv::VideoCapture videoCapture;
+	uint64_t sequence = 0;
+
+public:
+	CameraSource(const int camID, const int width, const int height)
+	{
+		videoCapture.open(camID, cv::CAP_ANY);
+		videoCapture.set(cv::CAP_PROP_FRAME_WIDTH, width);
+		videoCapture.set(cv::CAP_PROP_FRAME_HEIGHT, height);
+	}
+
+	bool read(Frame &frame) override
+	{
+		if (!videoCapture.read(frame.image))
+			return false;
+		frame.format = PixelFormat::BGR;
+		frame.captured = steady_clock::now();
+		frame.sequence = sequence++;
+		return true;
+	}
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+using std::array;
+
+/*
+	BGR to HSV conversion that produces exactly what cv::cvtColor(..., cv::COLOR_BGR2HSV)
+	produces for 8 bit images (same fixed point tables and rounding), but one row at a time
+	so callers can threshold or classify the result while it is still in cache instead of
+	storing a full hsv frame.
+
+	The vectorized paths are chosen at compile time (-mavx2 / -msse4.1 or -march=native),
+	otherwise the scalar path is used.
+*/
+class HSVKernel
+{
+private:
+	static constexpr int HSV_SHIFT = 12;
+	static constexpr int HSV_ROUND = 1 << (HSV_SHIFT - 1);
+	static constexpr int HUE_RANGE = 180;
+
+	struct Tables
+	{
+		alignas(32) array<int32_t, 256> sdiv;
+		alignas(32) array<int32_t, 256> hdiv;
+
+		Tables()
+		{
+			sdiv[0] = hdiv[0] = 0;
+			for (int i = 1; i < 256; i++)
+			{
+				sdiv[i] = cv::saturate_cast<int>((255 << HSV_SHIFT) / (1. * i));
+				hdiv[i] = cv::saturate_cast<int>((HUE_RANGE << HSV_SHIFT) / (6. * i));
+			}
+		}
+	};
+
+	inline static const Tables tables;
+
+public:
+	static void pixel(const uint8_t *bgr, uint8_t &h, uint8_t &s, uint8_t &v)
+	{
+		const int b = bgr[0], g = bgr[1], r = bgr[2];
+		const int vmax = std::max(std::max(b, g), r);
+		const int vmin = std::min(std::min(b, g), r);
+		const int diff = vmax - vmin;
+		const int vr = vmax == r ? -1 : 0;
+		const int vg = vmax == g ? -1 : 0;
+
+		const int sat = (diff * tables.sdiv[vmax] + HSV_ROUND) >> HSV_SHIFT;
+		int hue = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+		hue = (hue * tables.hdiv[diff] + HSV_ROUND) >> HSV_SHIFT;
+		hue += hue < 0 ? HUE_RANGE : 0;
+
+		h = cv::saturate_cast<uint8_t>(hue);
+		s = (uint8_t)sat;
+		v = (uint8_t)vmax;
+	}
+
+#if defined(__SSE4_1__)
+private:
+	// shuffle masks that pick channel c of 16 interleaved pixels out of the k-th 16 byte chunk
+	struct DeinterleaveMasks
+	{
+		alignas(16) int8_t m[3][3][16];
+
+		DeinterleaveMasks()
+		{
+			for (int c = 0; c < 3; c++)
+				for (int k = 0; k < 3; k++)
+					for (int pos = 0; pos < 16; pos++)
+					{
+						const int index = 3 * pos + c - 16 * k;
+						m[c][k][pos] = (index >= 0 && index < 16) ? (int8_t)index : (int8_t)-128;
+					}
+		}
+	};
+
+	inline static const DeinterleaveMasks masks;
+
+	static __m128i channel(const __m128i chunks[3], const int c)
+	{
+		__m128i result = _mm_shuffle_epi8(chunks[0], _mm_load_si128((const __m128i *)masks.m[c][0]));
+		result = _mm_or_si128(result, _mm_shuffle_epi8(chunks[1], _mm_load_si128((const __m128i *)masks.m[c][1])));
+		return _mm_or_si128(result, _mm_shuffle_epi8(chunks[2], _mm_load_si128((const __m128i *)masks.m[c][2])));
+	}
+
+#if defined(__AVX2__)
+	// hue and saturation of 8 pixels given as 32 bit lanes
+	static void hueSat8(const __m256i b, const __m256i g, const __m256i r, __m256i &h, __m256i &s)
+	{
+		const __m256i vmax = _mm256_max_epi32(_mm256_max_epi32(b, g), r);
+		const __m256i vmin = _mm256_min_epi32(_mm256_min_epi32(b, g), r);
+		const __m256i diff = _mm256_sub_epi32(vmax, vmin);
+		const __m256i vr = _mm256_cmpeq_epi32(vmax, r);
+		const __m256i vg = _mm256_cmpeq_epi32(vmax, g);
+		const __m256i round = _mm256_set1_epi32(HSV_ROUND);
+
+		const __m256i sdiv = _mm256_i32gather_epi32(tables.sdiv.data(), vmax, 4);
+		s = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), round), HSV_SHIFT);
+
+		const __m256i hr = _mm256_sub_epi32(g, b);
+		const __m256i hg = _mm256_add_epi32(_mm256_sub_epi32(b, r), _mm256_slli_epi32(diff, 1));
+		const __m256i hb = _mm256_add_epi32(_mm256_sub_epi32(r, g), _mm256_slli_epi32(diff, 2));
+		__m256i hue = _mm256_blendv_epi8(_mm256_blendv_epi8(hb, hg, vg), hr, vr);
+
+		const __m256i hdiv = _mm256_i32gather_epi32(tables.hdiv.data(), diff, 4);
+		hue = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(hue, hdiv), round), HSV_SHIFT);
+		h = _mm256_add_epi32(hue, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), hue), _mm256_set1_epi32(HUE_RANGE)));
+	}
+
+	static __m128i packTo8(const __m256i lo, const __m256i hi)
+	{
+		const __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		return _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+	}
+#else
+	static __m128i gather4(const int32_t *table, const __m128i index)
+	{
+		return _mm_setr_epi32(
+			table[_mm_extract_epi32(index, 0)],
+			table[_mm_extract_epi32(index, 1)],
+			table[_mm_extract_epi32(index, 2)],
+			table[_mm_extract_epi32(index, 3)]);
+	}
+
+	// hue and saturation of 4 pixels given as 32 bit lanes
+	static void hueSat4(const __m128i b, const __m128i g, const __m128i r, __m128i &h, __m128i &s)
+	{
+		const __m128i vmax = _mm_max_epi32(_mm_max_epi32(b, g), r);
+		const __m128i vmin = _mm_min_epi32(_mm_min_epi32(b, g), r);
+		const __m128i diff = _mm_sub_epi32(vmax, vmin);
+		const __m128i vr = _mm_cmpeq_epi32(vmax, r);
+		const __m128i vg = _mm_cmpeq_epi32(vmax, g);
+		const __m128i round = _mm_set1_epi32(HSV_ROUND);
+
+		s = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(diff, gather4(tables.sdiv.data(), vmax)), round), HSV_SHIFT);
+
+		const __m128i hr = _mm_sub_epi32(g, b);
+		const __m128i hg = _mm_add_epi32(_mm_sub_epi32(b, r), _mm_slli_epi32(diff, 1));
+		const __m128i hb = _mm_add_epi32(_mm_sub_epi32(r, g), _mm_slli_epi32(diff, 2));
+		__m128i hue = _mm_blendv_epi8(_mm_blendv_epi8(hb, hg, vg), hr, vr);
+
+		hue = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(hue, gather4(tables.hdiv.data(), diff)), round), HSV_SHIFT);
+		h = _mm_add_epi32(hue, _mm_and_si128(_mm_cmpgt_epi32(_mm_setzero_si128(), hue), _mm_set1_epi32(HUE_RANGE)));
+	}
+
+	static __m128i packTo8(const __m128i q0, const __m128i q1, const __m128i q2, const __m128i q3)
+	{
+		return _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3));
+	}
+#endif
+
+public:
+	// hsv of 16 consecutive pixels, one byte per pixel in each output
+	static void pixels16(const uint8_t *bgr, __m128i &h, __m128i &s, __m128i &v)
+	{
+		const __m128i chunks[3] = {
+			_mm_loadu_si128((const __m128i *)bgr),
+			_mm_loadu_si128((const __m128i *)(bgr + 16)),
+			_mm_loadu_si128((const __m128i *)(bgr + 32))};
+
+		const __m128i b = channel(chunks, 0);
+		const __m128i g = channel(chunks, 1);
+		const __m128i r = channel(chunks, 2);
+		v = _mm_max_epu8(_mm_max_epu8(b, g), r);
+
+#if defined(__AVX2__)
+		__m256i h0, h1, s0, s1;
+		hueSat8(_mm256_cvtepu8_epi32(b), _mm256_cvtepu8_epi32(g), _mm256_cvtepu8_epi32(r), h0, s0);
+		hueSat8(_mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)), _mm256_cvtepu8_epi32(_mm_srli_si128(g, 8)), _mm256_cvtepu8_epi32(_mm_srli_si128(r, 8)), h1, s1);
+		h = packTo8(h0, h1);
+		s = packTo8(s0, s1);
+#else
+		__m128i hq[4], sq[4];
+		hueSat4(_mm_cvtepu8_epi32(b), _mm_cvtepu8_epi32(g), _mm_cvtepu8_epi32(r), hq[0], sq[0]);
+		hueSat4(_mm_cvtepu8_epi32(_mm_srli_si128(b, 4)), _mm_cvtepu8_epi32(_mm_srli_si128(g, 4)), _mm_cvtepu8_epi32(_mm_srli_si128(r, 4)), hq[1], sq[1]);
+		hueSat4(_mm_cvtepu8_epi32(_mm_srli_si128(b, 8)), _mm_cvtepu8_epi32(_mm_srli_si128(g, 8)), _mm_cvtepu8_epi32(_mm_srli_si128(r, 8)), hq[2], sq[2]);
+		hueSat4(_mm_cvtepu8_epi32(_mm_srli_si128(b, 12)), _mm_cvtepu8_epi32(_mm_srli_si128(g, 12)), _mm_cvtepu8_epi32(_mm_srli_si128(r, 12)), hq[3], sq[3]);
+		h = packTo8(hq[0], hq[1], hq[2], hq[3]);
+		s = packTo8(sq[0], sq[1], sq[2], sq[3]);
+#endif
+	}
+
+	// 0xff in every byte where low <= x <= high (unsigned)
+	static __m128i inRange(const __m128i x, const uint8_t low, const uint8_t high)
+	{
+		const __m128i aboveLow = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8((char)low)), x);
+		const __m128i belowHigh = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8((char)high)), x);
+		return _mm_and_si128(aboveLow, belowHigh);
+	}
+#endif
+
+public:
+	// converts count pixels of an interleaved bgr row into three planar hsv rows
+	static void row(const uint8_t *bgr, uint8_t *h, uint8_t *s, uint8_t *v, const int count)
+	{
+		int x = 0;
+#if defined(__SSE4_1__)
+		for (; x + 16 <= count; x += 16, bgr += 48)
+		{
+			__m128i vh, vs, vv;
+			pixels16(bgr, vh, vs, vv);
+			_mm_storeu_si128((__m128i *)(h + x), vh);
+			_mm_storeu_si128((__m128i *)(s + x), vs);
+			_mm_storeu_si128((__m128i *)(v + x), vv);
+		}
+#endif
+		for (; x < count; x++, bgr += 3)
+			pixel(bgr, h[x], s[x], v[x]);
+	}
+
+	// same result as cvtColor(bgr, hsv, cv::COLOR_BGR2HSV) followed by cv::inRange(hsv, low, high, mask)
+	static void threshold(const cv::Mat &bgr, const cv::Vec3b low, const cv::Vec3b high, cv::Mat &mask)
+	{
+		mask.create(bgr.size(), CV_8UC1);
+
+		for (int y = 0; y < bgr.rows; y++)
+		{
+			const uint8_t *src = bgr.ptr<uint8_t>(y);
+			uint8_t *dst = mask.ptr<uint8_t>(y);
+
+			int x = 0;
+#if defined(__SSE4_1__)
+			for (; x + 16 <= bgr.cols; x += 16, src += 48)
+			{
+				__m128i vh, vs, vv;
+				pixels16(src, vh, vs, vv);
+				const __m128i in = _mm_and_si128(
+					inRange(vh, low[0], high[0]),
+					_mm_and_si128(inRange(vs, low[1], high[1]), inRange(vv, low[2], high[2])));
+				_mm_storeu_si128((__m128i *)(dst + x), in);
+			}
+#endif
+			for (; x < bgr.cols; x++, src += 3)
+			{
+				uint8_t h, s, v;
+				pixel(src, h, s, v);
+				const bool in = h >= low[0] && h <= high[0] &&
+								s >= low[1] && s <= high[1] &&
+								v >= low[2] && v <= high[2];
+				dst[x] = in ? 255 : 0;
+			}
+		}
+	}
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+#include "Point.hpp"
+
+using std::span;
+using std::vector;
+
+// intrinsics and distortion coefficients as cv::calibrateCamera reports them
+struct LensCalibration
+{
+	// the resolution the calibration was done at, other resolutions are scaled from it
+	cv::Size size;
+	float fx, fy, cx, cy;
+	float k1 = 0.f, k2 = 0.f, p1 = 0.f, p2 = 0.f, k3 = 0.f;
+};
+
+/*
+	Removes lens distortion from single points instead of remapping whole frames.
+
+	A point is undistorted by fixed point iteration of the Brown-Conrady model, the same way
+	cv::undistortPoints does it, and mapped back to pixels with the same intrinsics, so the
+	result can go through the linear camera model as if the lens had no distortion.
+
+	The iteration is done once per cell corner of a coarse grid when the frame size is set,
+	per frame a point costs a bilinear lookup. Points outside the frame are iterated directly.
+*/
+class LensDistortion
+{
+private:
+	// interpolation error stays around 0.02 px in the corners even with strong barrel distortion
+	inline static const int GRID_STEP = 8;
+	inline static const int ITERATIONS = 10;
+
+	float fx = 1.f, fy = 1.f, cx = 0.f, cy = 0.f;
+	float k1 = 0.f, k2 = 0.f, p1 = 0.f, p2 = 0.f, k3 = 0.f;
+
+	cv::Size size;
+	int gridCols = 0;
+	int gridRows = 0;
+	vector<Point2D> grid;
+
+public:
+	LensDistortion() = default;
+
+	LensDistortion(const LensCalibration &calibration, const cv::Size frameSize)
+		: k1(calibration.k1), k2(calibration.k2), p1(calibration.p1), p2(calibration.p2), k3(calibration.k3), size(frameSize)
+	{
+		// intrinsics are in pixels, they follow the resolution
+		const float sx = (float)frameSize.width / calibration.size.width;
+		const float sy = (float)frameSize.height / calibration.size.height;
+		fx = calibration.fx * sx;
+		fy = calibration.fy * sy;
+		cx = calibration.cx * sx;
+		cy = calibration.cy * sy;
+
+		gridCols = (frameSize.width + GRID_STEP - 1) / GRID_STEP + 1;
+		gridRows = (frameSize.height + GRID_STEP - 1) / GRID_STEP + 1;
+		grid.resize((size_t)gridCols * gridRows);
+		for (int row = 0; row < gridRows; row++)
+			for (int col = 0; col < gridCols; col++)
+				grid[(size_t)row * gridCols + col] = undistortExact(Point2D((float)col * GRID_STEP, (float)row * GRID_STEP));
+	}
+
+	const cv::Size &frameSize() const
+	{
+		return size;
+	}
+
+	// iterates the distortion model backwards, this is what the grid is built from
+	Point2D undistortExact(const Point2D pixel) const
+	{
+		const float xd = (pixel.x - cx) / fx;
+		const float yd = (pixel.y - cy) / fy;
+		float x = xd, y = yd;
+		for (int i = 0; i < ITERATIONS; i++)
+		{
+			const float r2 = x * x + y * y;
+			const float radial = 1.f + r2 * (k1 + r2 * (k2 + r2 * k3));
+			const float dx = 2.f * p1 * x * y + p2 * (r2 + 2.f * x * x);
+			const float dy = p1 * (r2 + 2.f * y * y) + 2.f * p2 * x * y;
+			x = (xd - dx) / radial;
+			y = (yd - dy) / radial;
+		}
+		return Point2D(x * fx + cx, y * fy + cy);
+	}
+
+	Point2D undistort(const Point2D pixel) const
+	{
+		const float gx = pixel.x / GRID_STEP;
+		const float gy = pixel.y / GRID_STEP;
+		const int col = (int)std::floor(gx);
+		const int row = (int)std::floor(gy);
+		if (col < 0 || row < 0 || col >= gridCols - 1 || row >= gridRows - 1)
+			return undistortExact(pixel);
+
+		const float tx = gx - col;
+		const float ty = gy - row;
+		const Point2D *top = &grid[(size_t)row * gridCols + col];
+		const Point2D *bottom = top + gridCols;
+		return (top[0] * (1.f - tx) + top[1] * tx) * (1.f - ty) + (bottom[0] * (1.f - tx) + bottom[1] * tx) * ty;
+	}
+
+	void undistort(span<const Point2D> pixels, span<Point2D> undistorted) const
+	{
+		const size_t count = std::min(pixels.size(), undistorted.size());
+		for (size_t i = 0; i < count; i++)
+			undistorted[i] = undistort(pixels[i]);
+	}
+};
@@ -4,13 +4,31 @@
 #include <opencv2/videoio.hpp>
 #include <opencv2/highgui.hpp>
 #include <chrono>
+#include <cstdio>
 #include <string>
 #include <vector>
 #include <cmath>
 #include <optional>
+#include <algorithm>
+#include <memory>
 
 #include "Utils.hpp"
 #include "Point.hpp"
+#include "Blob.hpp"
+#include "ColorClassifier.hpp"
+#include "BlobExtractor.hpp"
+#include "HSVKernel.hpp"
+#include "FrameSource.hpp"
+#include "FrameGrabber.hpp"
+#include "V4L2Source.hpp"
+#include "MjpegDecoder.hpp"
+#include "FrameRecorder.hpp"
+#include "FloorProjection.hpp"
+#include "LensDistortion.hpp"
+#include "Downsample.hpp"
+#include "WorkerPool.hpp"
+#include "ChangeMask.hpp"
+#include "ColorAdapter.hpp"
 
 using std::cos;
 using std::optional;
@@ -22,17 +40,89 @@ using std::chrono::duration;
 using std::chrono::steady_clock;
 using std::chrono::time_point;
 
+enum class CentroidMode
+{
+	// center of the pixels of a blob
+	BINARY,
+	// pixels weighted by their brightness, sub-pixel precision
+	INTENSITY,
+};
+
+enum class DetectionMode
+{
+	// every pixel of a region is classified
+	FULL,
+	// a downsampled region is classified first, then only windows around what was found
+	PYRAMID,
+};
+
+enum class CaptureBackend
+{
+	// cv::VideoCapture, bgr frames
+	OPENCV,
+	// the linux driver directly, yuv frames without any copy
+	V4L2,
+};
+
+enum class DisplayMode
+{
+	// no window and no drawing at all
+	HEADLESS,
+	// results are drawn on a copy of the frame on the display thread, at most displayHz times a second
+	WINDOW,
+};
+
 struct LocatorParams
 {
 	int camID;
 	int width;
 	int height;
+	CaptureBackend capture = CaptureBackend::OPENCV;
+	// YUYV, NV12 or MJPEG, for CaptureBackend::V4L2
+	PixelFormat captureFormat = PixelFormat::YUYV;
+	// MJPEG frames are decoded at 1 / jpegScale (1, 2, 4 or 8) for detection, on jpegThreads threads
+	int jpegScale = 2;
+	int jpegThreads = 1;
 	float zc;
 	float thetaDeg;
 	float d;
 	float sw;
 	float sh;
+	// draws every detection step on the frame, needs DisplayMode::WINDOW
 	bool helper;
+	CentroidMode centroid = CentroidMode::BINARY;
+	DetectionMode detection = DetectionMode::FULL;
+	// 2 or 4, how much smaller the coarse frame of DetectionMode::PYRAMID is on each side
+	int pyramidScale = 2;
+	// threads search windows are labeled on, including the detect thread, see Locator::workers
+	int detectThreads = 1;
+	// labelChanges only labels tiles whose brightness changed by more than changeThreshold,
+	// and the whole frame every refreshFrames frames, without it labelChanges is labelFrame
+	bool changeGating = false;
+	int changeThreshold = 24;
+	int refreshFrames = 30;
+	// registered color ranges follow slow changes of the light, from the blobs sampleBlob is given, see ColorAdapter
+	bool adaptColors = false;
+	DisplayMode display = DisplayMode::WINDOW;
+	float displayHz = 10.f;
+	// frames processed per second at most, 0 processes every frame as soon as it arrives
+	float targetHz = 0.f;
+	// without it the lens is assumed to have no distortion
+	optional<LensCalibration> lens = std::nullopt;
+	// frames come from this FrameRecorder file instead of the camera when it is set
+	string replayPath = "";
+	// raw YUYV or NV12 frames of width x height in captureFormat, one after the other, are
+	// played instead of the camera when it is set, see RawFileSource
+	string rawPath = "";
+	// replay with the recorded timing, or as fast as frames are processed without dropping any,
+	// for rawPath too
+	bool replayPaced = true;
+	// every captured frame is recorded to this file when it is set
+	string recordPath = "";
+	// where the camera stands in the arena, robots found are in its own floor coordinates until RobotTable moves them
+	CameraPlacement placement = {};
+	// name of the window print shows the frame in
+	string window = "result";
 };
 
 struct RegionOfInterest
@@ -48,6 +138,11 @@ struct RegionOfInterest
 	{
 	}
 
+	RegionOfInterest(const cv::Rect &rect)
+		: rect(rect)
+	{
+	}
+
 	void ensureWithinImage(const cv::Mat &img)
 	{
 		if (rect.x < 0)
@@ -63,6 +158,13 @@ struct RegionOfInterest
 	}
 };
 
+// a blob of a registered color, for locating from many threads at once
+struct ClassLocation
+{
+	Point2D pixel;
+	Point3D world;
+};
+
 class Locator
 {
 private:
@@ -74,6 +176,19 @@ private:
 	// just to smooth the fps calculation
 	inline static const float LAMBDA_FPS = 0.3f;
 
+	// robots may share a color so keep enough blobs per class for all of them
+	inline static const int MAX_BLOBS_PER_CLASS = 256;
+
+	// smaller blobs are noise
+	inline static const double MIN_BLOB_AREA = 3.;
+
+	// full resolution pixels added around a coarse blob before it is searched again
+	inline static const int PYRAMID_MARGIN = 4;
+
+	// pixels around a blob sampled for ColorAdapter, the edge of an LED is where it fades out of its range
+	inline static const int SAMPLE_MARGIN = 2;
+	inline static const int MAX_SAMPLES_PER_BLOB = 256;
+
 private:
 	// parameters and things that depend on parameters
 	LocatorParams params;
@@ -91,31 +206,374 @@ private:
 
 	optional<time_point<steady_clock>> time;
 
+	// frames processed when print last ran, print may run less often than frames arrive
+	uint64_t printedFrames = 0;
+
 private:
-	// to capture images from the camera
-	cv::VideoCapture videoCapture;
+	// captures frames on its own thread
+	FrameGrabber grabber;
 
 	// keep these here instead of allocating them each time
+
+	// the frame as captured, _frame is its bgr version and for yuv frames only made when needed
+	cv::Mat _image;
+	PixelFormat _format = PixelFormat::BGR;
+	cv::Size _frame_size;
 	cv::Mat _frame;
-	cv::Mat _hsv_frame;
+	bool _frame_ready = false;
+	cv::Mat _value_frame;
+
+	// for jpeg frames _image is not there, only a reduced copy and the compressed data
+	shared_ptr<const vector<uint8_t>> _encoded;
+	int _scale = 1;
+	cv::Mat _reduced;
+	JpegDecoder jpeg;
+	// full resolution windows of a reduced jpeg frame, all decoded in one pass into _jpeg_bgr
+	vector<cv::Rect> _jpeg_windows;
+	cv::Mat _jpeg_bgr;
+	cv::Rect _jpeg_decoded;
+	time_point<steady_clock> _frame_time;
+	uint64_t _frame_sequence = 0;
+	// regions of interest differ in size, the mask is a view of storage that only grows
 	cv::Mat _frame_threshold;
+	cv::Mat _frame_threshold_storage;
 	Point2D _pixel_xy;
 	Point2D _image_plane_uv;
 	Point3D _image_plane_xyz;
 	Point3D _world_xyz;
 	cv::Vec3b avgColor;
-	vector<vector<cv::Point>> _contours;
+	// text drawn in helper mode on the detect thread and by print on the display thread
+	string _helper_text;
+	string _print_text;
+	cv::Mat _shown;
+	BlobExtractor maskExtractor{255, 1, MIN_BLOB_AREA};
+
+	// single pass labeling of all registered colors, classExtractor gathers what every worker found
+	ColorClassifier classifier;
+	cv::Mat _label_frame;
+	vector<cv::Rect> _regions;
+	array<cv::Vec3b, ColorClassifier::MAX_CLASSES + 1> classColors;
+	BlobExtractor classExtractor{ColorClassifier::MAX_CLASSES, MAX_BLOBS_PER_CLASS, MIN_BLOB_AREA};
+	ColorAdapter colorAdapter;
+
+	// everything labeling a region changes, one per worker so regions are labeled in parallel
+	struct RegionWorker
+	{
+		ColorClassifier classifier;
+		BlobExtractor extractor{ColorClassifier::MAX_CLASSES, MAX_BLOBS_PER_CLASS, MIN_BLOB_AREA};
+
+		// coarse pass of DetectionMode::PYRAMID, any blob there may be an LED. Regions differ in
+		// size from call to call, the buffers are views of storage that only grows
+		cv::Mat _coarse_frame;
+		cv::Mat _coarse_labels;
+		cv::Mat _coarse_frame_storage;
+		cv::Mat _coarse_labels_storage;
+		vector<cv::Rect> _fine_regions;
+		vector<cv::Rect> _windows;
+		BlobExtractor coarseExtractor{ColorClassifier::MAX_CLASSES, MAX_BLOBS_PER_CLASS, 1.};
+	};
+	WorkerPool pool;
+	vector<unique_ptr<RegionWorker>> regionWorkers;
+
+	// fraction of the frame the last labeling classified
+	float labeledFraction = 0.f;
+
+	// blobs of the last labelChanges, they are still there in the tiles that did not change
+	ChangeMask changeMask;
+	vector<cv::Rect> _changed;
+	vector<std::pair<uint8_t, Blob>> _previous_blobs;
+	bool previousComplete = false;
+	int sinceRefresh = 0;
+
+	// pixel to floor in one step, built from the camera model or fitted from known points
+	FloorProjection projection;
+	cv::Size projectionSize;
+	bool projectionFitted = false;
+
+	// undistorts found centroids before they are projected, the frame itself stays distorted
+	optional<LensDistortion> lens;
+	vector<Point2D> _undistorted;
+
+private:
+	// the camera model is rebuilt for the new size, a fitted projection is scaled to it
+	void resizeProjection(const cv::Size size)
+	{
+		if (projectionFitted)
+			projection = projection.resized(projectionSize, size);
+		else
+			projection = FloorProjection::fromCamera(size, params.zc, theta, params.d, params.sw, params.sh);
+		projectionSize = size;
+
+		if (params.lens)
+			lens = LensDistortion(params.lens.value(), size);
+	}
+
+	// where pixel would be without lens distortion
+	Point2D undistort(const Point2D pixel) const
+	{
+		return lens ? lens.value().undistort(pixel) : pixel;
+	}
+
+	// undistorted copy of pixels, or pixels themselves when there is no distortion
+	span<const Point2D> undistort(span<const Point2D> pixels)
+	{
+		if (!lens)
+			return pixels;
+		_undistorted.resize(pixels.size());
+		lens.value().undistort(pixels, _undistorted);
+		return _undistorted;
+	}
+
+	// the dimmest pixel of a range gets weight 1 in weighted centroids
+	static uint8_t weightFloor(const cv::Vec3b lower_hsv)
+	{
+		return lower_hsv[2] > 0 ? lower_hsv[2] - 1 : 0;
+	}
+
+	// clips regions to the frame and replaces overlapping regions with their union
+	void mergeRegions(vector<cv::Rect> &regions) const
+	{
+		const cv::Rect image(0, 0, _frame_size.width, _frame_size.height);
+		for (cv::Rect &r : regions)
+			r &= image;
+		std::erase_if(regions, [](const cv::Rect &r)
+					  { return r.empty(); });
+
+		bool merged = true;
+		while (merged)
+		{
+			merged = false;
+			for (size_t i = 0; i < regions.size() && !merged; i++)
+			{
+				for (size_t j = i + 1; j < regions.size(); j++)
+				{
+					if ((regions[i] & regions[j]).empty())
+						continue;
+					regions[i] |= regions[j];
+					regions.erase(regions.begin() + j);
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+
+	// brightness is only needed by the extractor for weighted centroids
+	cv::Mat centroidWeights(const cv::Mat &brightness) const
+	{
+		return params.centroid == CentroidMode::INTENSITY ? brightness : cv::Mat();
+	}
+
+	// regions of different calls must not overlap, they share _label_frame and _value_frame
+	void labelRegion(RegionWorker &w, const cv::Rect &region) const
+	{
+		cv::Mat labels = _label_frame(region);
+		cv::Mat value = _value_frame(region);
+		if (_scale > 1)
+		{
+			// full resolution exists only for the windows labelMerged decoded
+			const cv::Rect inDecoded(region.x - _jpeg_decoded.x, region.y - _jpeg_decoded.y, region.width, region.height);
+			w.classifier.classify(_jpeg_bgr, PixelFormat::BGR, inDecoded, labels, value);
+		}
+		else
+		{
+			w.classifier.classify(_image, _format, region, labels, value);
+		}
+		w.extractor.extract(labels, region.tl(), centroidWeights(value));
+	}
+
+	// labels a downsampled copy of region and adds a full resolution window around every blob to windows
+	void findCandidates(RegionWorker &w, const cv::Rect &region, vector<cv::Rect> &windows) const
+	{
+		// reduced jpeg frames already are the coarse frame
+		const int scale = _scale > 1 ? _scale : params.pyramidScale;
+		cv::Point origin = region.tl();
+		if (_scale > 1)
+		{
+			const cv::Rect coarse = cv::Rect(
+										region.x / scale,
+										region.y / scale,
+										(region.x + region.width + scale - 1) / scale - region.x / scale,
+										(region.y + region.height + scale - 1) / scale - region.y / scale) &
+									cv::Rect(0, 0, _reduced.cols, _reduced.rows);
+			w._coarse_frame = _reduced(coarse);
+			origin = cv::Point(coarse.x * scale, coarse.y * scale);
+		}
+		else
+		{
+			fitView(w._coarse_frame_storage, w._coarse_frame, cv::Size((region.width + scale - 1) / scale, (region.height + scale - 1) / scale), CV_8UC3);
+			Downsample::brightest(_image, _format, region, scale, w._coarse_frame);
+		}
+		fitView(w._coarse_labels_storage, w._coarse_labels, w._coarse_frame.size(), CV_8UC1);
+		w.classifier.classify(w._coarse_frame, w._coarse_labels);
+
+		w.coarseExtractor.begin();
+		w.coarseExtractor.extract(w._coarse_labels);
+		for (uint8_t label = 1; label <= w.classifier.classCount(); label++)
+		{
+			for (const Blob &blob : w.coarseExtractor.get(label))
+			{
+				windows.emplace_back(
+					origin.x + blob.bbox.x * scale - PYRAMID_MARGIN,
+					origin.y + blob.bbox.y * scale - PYRAMID_MARGIN,
+					blob.bbox.width * scale + 2 * PYRAMID_MARGIN,
+					blob.bbox.height * scale + 2 * PYRAMID_MARGIN);
+			}
+		}
+	}
+
+	// the windows of region that are labeled at full resolution, added to windows
+	void fineWindows(RegionWorker &w, const cv::Rect &region, vector<cv::Rect> &windows) const
+	{
+		// regions that are already small are not worth a coarse pass
+		const int scale = _scale > 1 ? _scale : params.pyramidScale;
+		if ((params.detection == DetectionMode::FULL && _scale == 1) || region.width < 8 * scale || region.height < 8 * scale)
+		{
+			windows.push_back(region);
+			return;
+		}
+
+		// windows stay inside their region so no other worker labels the same pixels
+		w._fine_regions.clear();
+		findCandidates(w, region, w._fine_regions);
+		for (cv::Rect &window : w._fine_regions)
+			window &= region;
+		mergeRegions(w._fine_regions);
+		windows.insert(windows.end(), w._fine_regions.begin(), w._fine_regions.end());
+	}
+
+	// everything labelRegions does for one merged region, on worker w
+	void labelArea(RegionWorker &w, const cv::Rect &region) const
+	{
+		w._windows.clear();
+		fineWindows(w, region, w._windows);
+		for (const cv::Rect &window : w._windows)
+			labelRegion(w, window);
+	}
+
+	// labels regions and gathers the blobs every worker found in classExtractor
+	void labelMerged(vector<cv::Rect> &regions)
+	{
+		classExtractor.begin();
+
+		_label_frame.create(_frame_size, CV_8UC1);
+		_value_frame.create(_frame_size, CV_8UC1);
+		mergeRegions(regions);
+
+		int pixels = 0;
+		for (const cv::Rect &region : regions)
+			pixels += region.area();
+		labeledFraction = (float)pixels / std::max(_frame_size.area(), 1);
+
+		// merged regions do not overlap, each one is labeled by whichever worker takes it,
+		// largest first so no worker is left with a big one at the end
+		std::sort(regions.begin(), regions.end(), [](const cv::Rect &a, const cv::Rect &b)
+				  { return a.area() > b.area(); });
+		for (unique_ptr<RegionWorker> &w : regionWorkers)
+			w->extractor.begin();
+		if (_scale == 1)
+		{
+			pool.run((int)regions.size(), [&](const int worker, const int i)
+					 { labelArea(*regionWorkers[worker], regions[i]); });
+		}
+		else
+		{
+			// a jpeg can only be read from the top, the windows of all regions are found first
+			// and decoded together, then labeled in parallel
+			for (unique_ptr<RegionWorker> &w : regionWorkers)
+				w->_windows.clear();
+			pool.run((int)regions.size(), [&](const int worker, const int i)
+					 { RegionWorker &w = *regionWorkers[worker];
+					   fineWindows(w, regions[i], w._windows); });
+			_jpeg_windows.clear();
+			for (const unique_ptr<RegionWorker> &w : regionWorkers)
+				_jpeg_windows.insert(_jpeg_windows.end(), w->_windows.begin(), w->_windows.end());
+			std::sort(_jpeg_windows.begin(), _jpeg_windows.end(), [](const cv::Rect &a, const cv::Rect &b)
+					  { return a.area() > b.area(); });
+			if (jpeg.decodeRegions(*_encoded, _jpeg_windows, _jpeg_bgr, _jpeg_decoded))
+				pool.run((int)_jpeg_windows.size(), [&](const int worker, const int i)
+						 { labelRegion(*regionWorkers[worker], _jpeg_windows[i]); });
+		}
+
+		for (const unique_ptr<RegionWorker> &w : regionWorkers)
+			classExtractor.add(w->extractor);
+	}
+
+	// what labelChanges keeps of the current frame for the next one
+	void remember()
+	{
+		_previous_blobs.clear();
+		for (uint8_t label = 1; label <= classifier.classCount(); label++)
+		{
+			for (const Blob &blob : classExtractor.get(label))
+				_previous_blobs.emplace_back(label, blob);
+		}
+		previousComplete = true;
+	}
+
+	/*
+		What labelChanges keeps of a frame that was only labeled inside regions. Blobs of last
+		time that regions touch are replaced by the ones found now, the others are still what
+		the change mask last accepted their tiles with, so the next labelChanges only has to
+		look at what changed since.
+	*/
+	void rememberRegions(const vector<cv::Rect> &regions)
+	{
+		std::erase_if(_previous_blobs, [&](const std::pair<uint8_t, Blob> &previous)
+					  { return std::any_of(regions.begin(), regions.end(), [&](const cv::Rect &region)
+										   { return (region & previous.second.bbox).area() > 0; }); });
+		for (uint8_t label = 1; label <= classifier.classCount(); label++)
+		{
+			for (const Blob &blob : classExtractor.get(label))
+				_previous_blobs.emplace_back(label, blob);
+		}
+	}
 
 public:
 	Locator(const LocatorParams &params)
+		: Locator(params, makeSource(params))
 	{
-		setParams(params);
+	}
+
+	static unique_ptr<FrameSource> makeSource(const LocatorParams &params)
+	{
+		if (!params.replayPath.empty())
+		{
+			unique_ptr<ReplaySource> replay = std::make_unique<ReplaySource>(params.replayPath, params.replayPaced);
+			if (replay->format() == PixelFormat::MJPEG)
+				return std::make_unique<MjpegDecodeSource>(std::move(replay), params.jpegScale, params.jpegThreads);
+			return replay;
+		}
+		if (!params.rawPath.empty())
+		{
+			const PixelFormat format = params.captureFormat == PixelFormat::NV12 ? PixelFormat::NV12 : PixelFormat::YUYV;
+			return std::make_unique<RawFileSource>(params.rawPath, cv::Size(params.width, params.height), format, 30.f, params.replayPaced);
+		}
 
-		videoCapture.open(params.camID, cv::CAP_ANY);
-		videoCapture.set(cv::CAP_PROP_FRAME_WIDTH, params.width);
-		videoCapture.set(cv::CAP_PROP_FRAME_HEIGHT, params.height);
+		// jpeg is recorded before decoding, compressed and at full resolution
+		unique_ptr<FrameSource> camera;
+		if (params.capture == CaptureBackend::V4L2)
+			camera = std::make_unique<V4L2Source>("/dev/video" + to_string(params.camID), params.width, params.height, params.captureFormat);
+		else
+			camera = std::make_unique<CameraSource>(params.camID, params.width, params.height);
+		if (!params.recordPath.empty())
+			camera = std::make_unique<RecordingSource>(std::move(camera), params.recordPath);
+		if (params.capture == CaptureBackend::V4L2 && params.captureFormat == PixelFormat::MJPEG)
+			camera = std::make_unique<MjpegDecodeSource>(std::move(camera), params.jpegScale, params.jpegThreads);
+		return camera;
+	}
 
-		if (params.helper)
+	Locator(const LocatorParams &params, unique_ptr<FrameSource> source)
+		: grabber(std::move(source)),
+		  pool(params.detectThreads),
+		  changeMask(params.changeThreshold)
+	{
+		for (int i = 0; i < pool.size(); i++)
+			regionWorkers.push_back(std::make_unique<RegionWorker>());
+		setParams(params);
+		grabber.start();
+
+		if (params.helper && params.display == DisplayMode::WINDOW)
 		{
 			cv::namedWindow("Helper", cv::WINDOW_AUTOSIZE);
 
@@ -148,64 +606,75 @@ public:
 		theta = degToRad(params.thetaDeg);
 		cosTheta = std::cos(theta);
 		sinTheta = std::sin(theta);
+
+		projectionSize = cv::Size(params.width, params.height);
+		projection = FloorProjection::fromCamera(projectionSize, params.zc, theta, params.d, params.sw, params.sh);
+		projectionFitted = false;
+
+		lens = std::nullopt;
+		if (params.lens)
+			lens = LensDistortion(params.lens.value(), projectionSize);
+	}
+
+	// changes how frames are searched from the next labeling on, everything else stays
+	void setDetection(const DetectionMode detection, const int pyramidScale, const int refreshFrames)
+	{
+		params.detection = detection;
+		params.pyramidScale = pyramidScale;
+		params.refreshFrames = refreshFrames;
 	}
 
 	bool newFrame()
 	{
-		if (!videoCapture.read(_frame))
+		const Frame *frame = grabber.next();
+		if (!frame)
 			return false;
-		params.width = _frame.size().width;
-		params.height = _frame.size().height;
+		_image = frame->image;
+		_format = frame->format;
+		_encoded = frame->encoded;
+		_scale = frame->scale;
+		if (_scale > 1)
+			_reduced = frame->image;
+		_frame_size = frame->size();
+		_frame_time = frame->captured;
+		_frame_sequence = frame->sequence;
+		_frame_ready = false;
+		params.width = _frame_size.width;
+		params.height = _frame_size.height;
+		if (_frame_size != projectionSize)
+			resizeProjection(_frame_size);
 
-		// cv::stackBlur(_frame, _frame, cv::Size(5, 5));
-		cvtColor(_frame, _hsv_frame, cv::COLOR_BGR2HSV);
+		// helper mode draws on the frame as it goes
+		if (params.helper)
+			getFrame();
 		return true;
 	}
 
 	const optional<Point2D> locatePixelXY(const cv::Vec3b lower_hsv, const cv::Vec3b upper_hsv, optional<RegionOfInterest> roi)
 	{
-		cv::Point2i point{};
+		const cv::Mat &frame = getFrame();
+		cv::Rect rect(0, 0, frame.cols, frame.rows);
 
 		if (roi)
 		{
-			roi.value().ensureWithinImage(_hsv_frame);
-			point = {roi.value().rect.x, roi.value().rect.y};
-			cv::inRange(_hsv_frame(roi.value().rect), lower_hsv, upper_hsv, _frame_threshold);
-		}
-		else
-		{
-			cv::inRange(_hsv_frame, lower_hsv, upper_hsv, _frame_threshold);
-		}
-
-		cv::findContours(_frame_threshold, _contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-
-		double max_area = 0;
-		int largest_contour = -1;
-		for (int i = 0; i < _contours.size(); i++)
-		{
-			const double area = cv::contourArea(_contours[i]);
-			if (area > max_area)
-			{
-				max_area = area;
-				largest_contour = i;
-			}
+			roi.value().ensureWithinImage(frame);
+			rect = roi.value().rect;
 		}
+		fitView(_frame_threshold_storage, _frame_threshold, rect.size(), CV_8UC1);
+		HSVKernel::threshold(frame(rect), lower_hsv, upper_hsv, _frame_threshold);
 
-		cv::Moments m;
-		if (largest_contour >= 0)
-		{
-			cv::drawContours(_frame, _contours, -1, avgColor, 3, 8, cv::noArray(), INT_MAX, point);
-			m = cv::moments(_contours[largest_contour], true);
-		}
+		maskExtractor.setWeightFloor(255, weightFloor(lower_hsv));
+		maskExtractor.begin();
+		maskExtractor.extract(_frame_threshold, rect.tl(), centroidWeights(frame(rect)));
 
-		if (m.m00 != 0.)
-		{
-			_pixel_xy.x = float(m.m10 / m.m00 + point.x);
-			_pixel_xy.y = float(m.m01 / m.m00 + point.y);
-			return _pixel_xy;
-		}
+		const span<const Blob> found = maskExtractor.get(255);
+		if (found.empty())
+			return std::nullopt;
 
-		return std::nullopt;
+		if (params.helper)
+			cv::rectangle(_frame, found[0].bbox, avgColor, 3);
+		_pixel_xy = found[0].centroid;
+		return _pixel_xy;
 	}
 
 	const Point2D &pixelXYToImagePlaneUV(const Point2D &pixel_xy)
@@ -243,28 +712,272 @@ public:
 		return _world_xyz;
 	}
 
+	// ======================= Homography =======================
+
+	const FloorProjection &floorProjection() const
+	{
+		return projection;
+	}
+
+	// the floor projection moved up to LED height a
+	FloorProjection projectionAt(const float a) const
+	{
+		return a == projection.planeHeight() ? projection : projection.atHeight(a);
+	}
+
+	// where pixel is on the floor at LED height a, safe to call from many threads
+	optional<Point3D> pixelToFloor(const Point2D pixel, const float a = 0.f) const
+	{
+		return projectionAt(a).project(undistort(pixel));
+	}
+
+	// projects many pixels at once, the ones that miss the floor get NaN x and y
+	// returns how many hit the floor
+	size_t pixelsToFloor(span<const Point2D> pixels, span<Point3D> world, const float a = 0.f)
+	{
+		return projectionAt(a).project(undistort(pixels), world);
+	}
+
+	/*
+		Replaces the camera model with a homography fitted from at least 4 pixels of the
+		current resolution and the floor points they show. Floor coordinates have to put the
+		origin right below the camera, as the camera model does, so LED heights still work.
+		Lasts until the next setParams.
+	*/
+	bool fitFloorProjection(span<const Point2D> pixels, span<const Point2D> floor)
+	{
+		const optional<FloorProjection> fitted = FloorProjection::fit(undistort(pixels), floor, params.zc);
+		if (!fitted)
+			return false;
+		projection = fitted.value();
+		projectionSize = cv::Size(params.width, params.height);
+		projectionFitted = true;
+		return true;
+	}
+
 	const optional<Point3D> locateMarkAndGet(cv::Vec3b lower_hsv, cv::Vec3b upper_hsv, const float a, optional<RegionOfInterest> roi = std::nullopt)
 	{
-		cv::Mat3b bgrAvgColor;
-		cv::Mat3b hsvAvgColor(1, 1, lower_hsv * 0.5f + upper_hsv * 0.5f);
-		cv::cvtColor(hsvAvgColor, bgrAvgColor, cv::COLOR_HSV2BGR);
-		avgColor = bgrAvgColor[0][0];
+		avgColor = hsvToBGR(lower_hsv * 0.5f + upper_hsv * 0.5f);
 
 		if (!locatePixelXY(lower_hsv, upper_hsv, roi))
 			return std::nullopt;
-		addCircle(_pixel_xy, avgColor);
 
-		pixelXYToImagePlaneUV(_pixel_xy);
-		addText(_pixel_xy, cv::format("uv: (%f, %f)", _image_plane_uv.x, _image_plane_uv.y), avgColor);
+		return projectPixelXY(a);
+	}
+
+	// ======================= Labeling of all registered colors =======================
+
+	// returns the class label to be used with locateClassAndGet, identical ranges share a label
+	optional<uint8_t> registerColor(const cv::Vec3b lower_hsv, const cv::Vec3b upper_hsv)
+	{
+		const optional<uint8_t> label = classifier.addRange(lower_hsv, upper_hsv);
+		if (label)
+		{
+			colorAdapter.add(label.value(), HSVRange{lower_hsv, upper_hsv});
+			classColors[label.value()] = hsvToBGR(lower_hsv * 0.5f + upper_hsv * 0.5f);
+			for (unique_ptr<RegionWorker> &w : regionWorkers)
+			{
+				w->classifier = classifier;
+				w->extractor.setWeightFloor(label.value(), weightFloor(lower_hsv));
+			}
+		}
+		return label;
+	}
+
+	// classifies every pixel of the current frame once and collects the blobs of each class
+	void labelFrame()
+	{
+		_regions.assign(1, cv::Rect(0, 0, _frame_size.width, _frame_size.height));
+		labelRegions(_regions);
+	}
 
-		imagePlaneUVToImagePlaneXYZ(_image_plane_uv);
-		addText(_pixel_xy, cv::format("ip: (%f, %f, %f)", _image_plane_xyz.x, _image_plane_xyz.y, _image_plane_xyz.z), avgColor, 30);
+	// same as labelFrame but only pixels inside regions are classified, regions may overlap
+	// with DetectionMode::PYRAMID, or for reduced jpeg frames, only windows around blobs of a downsampled copy are classified at full resolution
+	void labelRegions(vector<cv::Rect> &regions)
+	{
+		labelMerged(regions);
+		if (previousComplete)
+			rememberRegions(regions);
+	}
+
+	/*
+		Same as labelFrame for frames where most of the floor did not change since the last
+		one. Only tiles whose brightness changed and tracked, windows around robots that are
+		known, are labeled, blobs everywhere else are the ones found last time. A blob from
+		last time that reaches into a labeled region is labeled again as a whole.
 
-		if (!imagePlaneXYZToFloor(_image_plane_xyz, a))
+		Falls back to labelFrame when nothing was labeled by labelChanges yet, when more than
+		half of the frame changed and every LocatorParams::refreshFrames frames. Frames labeled
+		by labelRegions in between keep what labelChanges remembered valid for the tiles they
+		did not touch.
+	*/
+	void labelChanges(const vector<cv::Rect> &tracked)
+	{
+		if (!params.changeGating)
+		{
+			labelFrame();
+			return;
+		}
+
+		// reduced jpeg frames are compared at their reduced size
+		const cv::Mat &image = _scale > 1 ? _reduced : _image;
+		const bool compared = changeMask.update(image, _scale > 1 ? PixelFormat::BGR : _format, _changed);
+		if (!compared || !previousComplete || ++sinceRefresh >= params.refreshFrames || changeMask.dirty() > 0.5f)
+		{
+			labelFrame();
+			changeMask.accept();
+			remember();
+			sinceRefresh = 0;
+			return;
+		}
+
+		for (cv::Rect &region : _changed)
+			region = cv::Rect(region.x * _scale, region.y * _scale, region.width * _scale, region.height * _scale);
+		_changed.insert(_changed.end(), tracked.begin(), tracked.end());
+		mergeRegions(_changed);
+		for (cv::Rect &region : _changed)
+		{
+			for (const std::pair<uint8_t, Blob> &previous : _previous_blobs)
+			{
+				if ((region & previous.second.bbox).area() > 0)
+					region |= previous.second.bbox;
+			}
+		}
+
+		labelMerged(_changed);
+		for (const std::pair<uint8_t, Blob> &previous : _previous_blobs)
+		{
+			const bool relabeled = std::any_of(_changed.begin(), _changed.end(), [&](const cv::Rect &region)
+											   { return (region & previous.second.bbox).area() > 0; });
+			if (!relabeled)
+				classExtractor.add(previous.first, previous.second);
+		}
+		remember();
+	}
+
+	// fraction of the pixels of the current frame the last labeling classified, blobs carried over by labelChanges cost nothing
+	float labeled() const
+	{
+		return labeledFraction;
+	}
+
+	// blobs of a class found by the last labelFrame or labelRegions, largest first
+	span<const Blob> blobs(const uint8_t label) const
+	{
+		return classExtractor.get(label);
+	}
+
+	// the range label classifies with now, the registered one unless LocatorParams::adaptColors moved it
+	const HSVRange &colorRange(const uint8_t label) const
+	{
+		return classifier.range(label);
+	}
+
+	/*
+		Samples the pixels around blob, a blob of the last labeling that is certainly an LED of
+		class label, for adaptColors. Only for LocatorParams::adaptColors. Reduced jpeg frames
+		are sampled at their reduced size.
+	*/
+	void sampleBlob(const uint8_t label, const Blob &blob)
+	{
+		if (!params.adaptColors || label == 0 || label > colorAdapter.classCount())
+			return;
+
+		const cv::Mat &image = _scale > 1 ? _reduced : _image;
+		const PixelFormat format = _scale > 1 ? PixelFormat::BGR : _format;
+		const cv::Size size = _scale > 1 ? _reduced.size() : _frame_size;
+		const cv::Rect grown(
+			blob.bbox.x / _scale - SAMPLE_MARGIN,
+			blob.bbox.y / _scale - SAMPLE_MARGIN,
+			blob.bbox.width / _scale + 1 + 2 * SAMPLE_MARGIN,
+			blob.bbox.height / _scale + 1 + 2 * SAMPLE_MARGIN);
+		const cv::Rect sampled = grown & cv::Rect(0, 0, size.width, size.height);
+
+		// large blobs are thinned out, every blob weighs about the same
+		const int step = std::max(1, (int)std::sqrt((double)sampled.area() / MAX_SAMPLES_PER_BLOB));
+		for (int y = sampled.y; y < sampled.y + sampled.height; y += step)
+		{
+			for (int x = sampled.x; x < sampled.x + sampled.width; x += step)
+			{
+				const cv::Vec3b bgr = YUVKernel::pixel(image, format, x, y);
+				uint8_t h, s, v;
+				HSVKernel::pixel(&bgr[0], h, s, v);
+				if (colorAdapter.near(label, h, s, v))
+					colorAdapter.sample(label, h, s, v);
+			}
+		}
+	}
+
+	// moves the ranges of the classes that have enough samples, takes effect from the next labeling
+	void adaptColors()
+	{
+		if (!params.adaptColors)
+			return;
+		for (uint8_t label = 1; label <= colorAdapter.classCount(); label++)
+		{
+			const optional<HSVRange> range = colorAdapter.adapt(label);
+			if (!range)
+				continue;
+			classifier.setRange(label, range.value().low, range.value().high);
+			for (unique_ptr<RegionWorker> &w : regionWorkers)
+			{
+				w->classifier.setRange(label, range.value().low, range.value().high);
+				w->extractor.setWeightFloor(label, weightFloor(range.value().low));
+			}
+		}
+	}
+
+	// the largest blob of a class whose centroid is inside roi
+	const Blob *findClass(const uint8_t label, const optional<RegionOfInterest> &roi) const
+	{
+		for (const Blob &blob : classExtractor.get(label))
+		{
+			if (roi && !roi.value().rect.contains(cv::Point((int)blob.centroid.x, (int)blob.centroid.y)))
+				continue;
+			return &blob;
+		}
+		return nullptr;
+	}
+
+	// same as locateMarkAndGet but uses the blobs found by labelFrame
+	const optional<Point3D> locateClassAndGet(const uint8_t label, const float a, optional<RegionOfInterest> roi = std::nullopt)
+	{
+		avgColor = classColors[label];
+
+		const Blob *found = findClass(label, roi);
+		if (!found)
 			return std::nullopt;
-		addText(_pixel_xy, cv::format(" r: (%f, %f, %f)", _world_xyz.x, _world_xyz.y, _world_xyz.z), avgColor, 60);
 
-		return _world_xyz;
+		if (params.helper)
+			cv::rectangle(_frame, found->bbox, avgColor, 3);
+		_pixel_xy = found->centroid;
+		return projectPixelXY(a);
+	}
+
+	// locateClassAndGet without touching any state of the locator or drawing anything, safe to call
+	// from many threads between two labelRegions
+	optional<ClassLocation> locateClass(const uint8_t label, const float a, const optional<RegionOfInterest> &roi = std::nullopt) const
+	{
+		const Blob *found = findClass(label, roi);
+		if (!found)
+			return std::nullopt;
+		return locateBlob(*found, a);
+	}
+
+	// where a blob of the last labeling is on the floor, at LED height a, safe to call from many threads
+	optional<ClassLocation> locateBlob(const Blob &blob, const float a) const
+	{
+		const optional<Point3D> world = pixelToFloor(blob.centroid, a);
+		if (!world)
+			return std::nullopt;
+		return ClassLocation{blob.centroid, world.value()};
+	}
+
+	// the threads of LocatorParams::detectThreads, they are idle outside of labelRegions and
+	// may be used for anything else that has to run once per robot
+	WorkerPool &workers()
+	{
+		return pool;
 	}
 
 	const Point3D &getWorldXYZ() const
@@ -277,6 +990,28 @@ public:
 		return _pixel_xy;
 	}
 
+	const time_point<steady_clock> &frameTime() const
+	{
+		return _frame_time;
+	}
+
+	// sequence number the source gave the current frame
+	uint64_t frameSequence() const
+	{
+		return _frame_sequence;
+	}
+
+	cv::Size frameSize() const
+	{
+		return _frame_size;
+	}
+
+	CaptureStats captureStats() const
+	{
+		return grabber.stats();
+	}
+
+	// handles gui events for up to interval_ms, false once ESC was pressed, only for DisplayMode::WINDOW
 	bool again(const int interval_ms) const
 	{
 		return cv::waitKey(interval_ms) != 27;
@@ -284,10 +1019,74 @@ public:
 
 	// ======================= Visual things =======================
 
-	void addText(const Point2D xy, const string text, const cv::Scalar color, const int offsetY = 0) const
+	// same as cv::COLOR_HSV2BGR for one pixel, without the two Mats cvtColor would need
+	static cv::Vec3b hsvToBGR(const cv::Vec3b hsv)
+	{
+		const float h = std::fmod(hsv[0] * 2.f, 360.f) / 60.f;
+		const float s = hsv[1] / 255.f;
+		const float v = hsv[2] / 255.f;
+		const int sector = std::min((int)h, 5);
+		const float f = h - sector;
+		const float p = v * (1.f - s);
+		const float q = v * (1.f - s * f);
+		const float t = v * (1.f - s * (1.f - f));
+
+		const float rgb[6][3] = {{v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q}};
+		const float *c = rgb[sector];
+		return cv::Vec3b(cv::saturate_cast<uint8_t>(c[2] * 255.f), cv::saturate_cast<uint8_t>(c[1] * 255.f), cv::saturate_cast<uint8_t>(c[0] * 255.f));
+	}
+
+	// printf into text, which keeps its buffer from call to call
+	template <class... Args>
+	static const string &formatText(string &text, const char *format, const Args... args)
+	{
+		const int length = std::max(std::snprintf(nullptr, 0, format, args...), 0);
+		text.resize(length);
+		std::snprintf(text.data(), length + 1, format, args...);
+		return text;
+	}
+
+	// projects _pixel_xy to the floor, in helper mode the intermediate results are written on the frame
+	const optional<Point3D> projectPixelXY(const float a)
+	{
+		const Point2D pixel = undistort(_pixel_xy);
+		const optional<Point3D> world = projectionAt(a).project(pixel);
+		if (world)
+			_world_xyz = world.value();
+
+		if (params.helper)
+		{
+			pixelXYToImagePlaneUV(pixel);
+			imagePlaneUVToImagePlaneXYZ(_image_plane_uv);
+			addCircle(_pixel_xy, avgColor);
+			addText(_pixel_xy, formatText(_helper_text, "uv: (%f, %f)", _image_plane_uv.x, _image_plane_uv.y), avgColor);
+			addText(_pixel_xy, formatText(_helper_text, "ip: (%f, %f, %f)", _image_plane_xyz.x, _image_plane_xyz.y, _image_plane_xyz.z), avgColor, 30);
+			if (world)
+				addText(_pixel_xy, formatText(_helper_text, " r: (%f, %f, %f)", _world_xyz.x, _world_xyz.y, _world_xyz.z), avgColor, 60);
+		}
+
+		return world;
+	}
+
+	void addText(const Point2D xy, const string &text, const cv::Scalar color, const int offsetY = 0) const
+	{
+		addText(_frame, xy, text, color, offsetY);
+	}
+
+	void addLine(const Point2D p1, const Point2D p2, cv::Scalar color) const
+	{
+		addLine(_frame, p1, p2, color);
+	}
+
+	void addCircle(const Point2D xy, cv::Scalar color) const
+	{
+		addCircle(_frame, xy, color);
+	}
+
+	static void addText(const cv::Mat &image, const Point2D xy, const string &text, const cv::Scalar color, const int offsetY = 0)
 	{
 		cv::putText(
-			_frame,
+			image,
 			text,
 			{(int)xy.x, (int)xy.y + offsetY},
 			cv::FONT_HERSHEY_SIMPLEX,
@@ -297,46 +1096,73 @@ public:
 			cv::LINE_4);
 	}
 
-	void addLine(const Point2D p1, const Point2D p2, cv::Scalar color) const
+	static void addLine(const cv::Mat &image, const Point2D p1, const Point2D p2, cv::Scalar color)
 	{
 		cv::line(
-			_frame,
+			image,
 			{(int)p1.x, (int)p1.y},
 			{(int)p2.x, (int)p2.y},
 			color);
 	}
 
-	void addCircle(const Point2D xy, cv::Scalar color) const
+	static void addCircle(const cv::Mat &image, const Point2D xy, cv::Scalar color)
 	{
 		cv::circle(
-			_frame,
+			image,
 			{(int)xy.x, (int)xy.y},
 			8,
 			color,
 			1);
 	}
 
-	void print()
+	// looks for the color picked with the helper trackbars, only in helper mode
+	void locateHelper()
 	{
 		if (params.helper)
 		{
 			locateMarkAndGet(helper_low, helper_high, 0.f);
 		}
+	}
 
-		addLine({params.width / 2.f, 0.f}, {params.width / 2.f, (float)params.height}, {255, 255, 255});
-		addLine({0.f, params.height / 2.f}, {(float)params.width, params.height / 2.f}, {255, 255, 255});
+	// the current frame as bgr, yuv frames are converted on the first call
+	const cv::Mat &getFrame()
+	{
+		if (!_frame_ready)
+		{
+			if (_scale > 1)
+				jpeg.decode(*_encoded, 1, _frame);
+			else
+				YUVKernel::toBGR(_image, _format, _frame);
+			_frame_ready = true;
+		}
+		return _frame;
+	}
 
-		const float yh = params.height * 0.5f - params.d * sinTheta / (params.sh * cosTheta);
-		addLine({0.f, yh}, {(float)params.width, yh}, {0, 0, 255});
+	// draws the reference lines and stats on image and shows it, image may be a copy of an older frame
+	void print(cv::Mat &image)
+	{
+		const float width = (float)image.cols;
+		const float height = (float)image.rows;
+
+		addLine(image, {width / 2.f, 0.f}, {width / 2.f, height}, {255, 255, 255});
+		addLine(image, {0.f, height / 2.f}, {width, height / 2.f}, {255, 255, 255});
 
+		const float yh = height * 0.5f - params.d * sinTheta / (params.sh * cosTheta);
+		addLine(image, {0.f, yh}, {width, yh}, {0, 0, 255});
+
+		const CaptureStats capture = grabber.stats();
 		const float seconds = time.has_value() ? duration<float>(steady_clock::now() - time.value()).count() : 1.f;
-		const float frames_per_second = 1.f / seconds;
+		const float frames_per_second = (capture.consumed - printedFrames) / seconds;
 		fps = frames_per_second * LAMBDA_FPS + (1.f - LAMBDA_FPS) * fps;
-		addText(Point2D(5, 50), cv::format("(%d, %d) | FPS: %f", params.width, params.height, fps), cv::Scalar(255, 255, 255));
+		printedFrames = capture.consumed;
+		addText(image, Point2D(5, 50), formatText(_print_text, "(%d, %d) | FPS: %f", image.cols, image.rows, fps), cv::Scalar(255, 255, 255));
+
+		addText(image, Point2D(5, 80), formatText(_print_text, "dropped: %llu / %llu | wait: %.1f ms | labeled: %.0f%%", (unsigned long long)capture.dropped, (unsigned long long)capture.captured, capture.lastWaitSeconds * 1000.f, labeledFraction * 100.f), cv::Scalar(255, 255, 255));
 
-		const float scale = 1280.f / params.width;
-		cv::resize(_frame, _frame, cv::Size(), scale, scale, cv::INTER_LINEAR);
-		imshow("result", _frame);
+		// resizing into image itself would need a new buffer every time
+		const float scale = 1280.f / image.cols;
+		cv::resize(image, _shown, cv::Size(), scale, scale, cv::INTER_LINEAR);
+		imshow(params.window, _shown);
 		time = steady_clock::now();
 	}
 };
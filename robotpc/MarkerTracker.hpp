@@ -0,0 +1,121 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <optional>
+
+#include "Point.hpp"
+
+using std::optional;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+/*
+	Follows one marker of a robot in pixel coordinates so it only needs to be searched for
+	in a small window around the place it is expected to be.
+
+	Position and velocity are smoothed with an alpha-beta filter. The window is sized from
+	the robot footprint in pixels (distance between its front and center LEDs) plus the
+	distance the marker may have moved since it was last seen, and grows every time the
+	marker is missed. After too many misses the track is lost and the caller should scan
+	the whole frame.
+*/
+class MarkerTracker
+{
+private:
+	inline static const float ALPHA = 0.85f;
+	inline static const float BETA = 0.3f;
+
+	// window half size never gets smaller than this (pixels)
+	inline static const float MIN_HALF_WINDOW = 30.f;
+
+	// window half size in units of the robot footprint
+	inline static const float FOOTPRINT_SCALE = 2.5f;
+
+	// window grows by this factor on every consecutive miss
+	inline static const float MISS_GROWTH = 1.6f;
+
+	inline static const int MAX_MISSES = 4;
+
+private:
+	optional<Point2D> position;
+	Point2D velocity{0.f, 0.f};
+	float footprint = 0.f;
+	int misses = 0;
+	time_point<steady_clock> lastSeen;
+
+public:
+	bool lost() const
+	{
+		return !position || misses > MAX_MISSES;
+	}
+
+	// expected position of the marker at time now
+	optional<Point2D> predict(const time_point<steady_clock> now) const
+	{
+		if (!position)
+			return std::nullopt;
+		const float dt = duration<float>(now - lastSeen).count();
+		return position.value() + velocity * dt;
+	}
+
+	// distance in pixels between the front and center LEDs, smoothed, nullopt while lost
+	optional<float> footprintPixels() const
+	{
+		if (lost() || footprint <= 0.f)
+			return std::nullopt;
+		return footprint;
+	}
+
+	// region to search at time now, nullopt means the whole frame must be searched
+	// scale shrinks or grows the window, smaller ones are cheaper but lose fast robots sooner
+	optional<cv::Rect> searchWindow(const time_point<steady_clock> now, const cv::Size frameSize, const float scale = 1.f) const
+	{
+		if (lost())
+			return std::nullopt;
+
+		const float dt = duration<float>(now - lastSeen).count();
+		const Point2D center = position.value() + velocity * dt;
+		const float travel = std::hypot(velocity.x, velocity.y) * dt;
+		const float half = (std::max(MIN_HALF_WINDOW, FOOTPRINT_SCALE * footprint) * scale + travel) * std::pow(MISS_GROWTH, (float)misses);
+
+		const cv::Rect window(int(center.x - half), int(center.y - half), int(2.f * half), int(2.f * half));
+		const cv::Rect clipped = window & cv::Rect(0, 0, frameSize.width, frameSize.height);
+		if (clipped.empty())
+			return std::nullopt;
+		return clipped;
+	}
+
+	// marker found at measured, footprintPx is the distance in pixels between front and center LEDs
+	void hit(const Point2D &measured, const float footprintPx, const time_point<steady_clock> now)
+	{
+		if (lost())
+		{
+			position = measured;
+			velocity = {0.f, 0.f};
+			footprint = footprintPx;
+		}
+		else
+		{
+			const float dt = duration<float>(now - lastSeen).count();
+			const Point2D predicted = position.value() + velocity * dt;
+			const Point2D residual = measured - predicted;
+
+			position = predicted + residual * ALPHA;
+			if (dt > 0.f)
+				velocity = velocity + residual * (BETA / dt);
+			footprint = footprint * 0.7f + footprintPx * 0.3f;
+		}
+
+		misses = 0;
+		lastSeen = now;
+	}
+
+	void miss()
+	{
+		misses++;
+	}
+};
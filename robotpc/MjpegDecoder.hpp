@@ -0,0 +1,355 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "FrameSource.hpp"
+#include "Utils.hpp"
+
+using std::atomic;
+using std::shared_ptr;
+using std::span;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+/*
+	JPEG decoding through libjpeg-turbo, which OpenCV links anyway, for what cv::imdecode
+	cannot do:
+
+	- decode at 1/2, 1/4 or 1/8 scale, the scaling happens in the inverse DCT so the skipped
+	  resolution costs nothing
+	- decode only some rectangles at full resolution in a single pass, columns outside all
+	  of them are cropped before the inverse DCT, rows no rectangle covers are only entropy
+	  decoded and rows below the last one not at all
+
+	One decoder per thread, it keeps its libjpeg state between images.
+*/
+class JpegDecoder
+{
+private:
+	struct ErrorManager
+	{
+		jpeg_error_mgr manager;
+		std::jmp_buf jump;
+	};
+
+	jpeg_decompress_struct info;
+	ErrorManager error;
+
+	// full size of the last image
+	cv::Size size;
+
+	// what decodeRegions decoded, the part it returns is a view of it and it is a view of
+	// storage that only grows
+	cv::Mat rows;
+	cv::Mat rowsStorage;
+	// rows of rows some region needs
+	vector<uint8_t> _needed;
+
+	JpegDecoder(const JpegDecoder &) = delete;
+	JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+private:
+	// libjpeg exits the process on errors unless told otherwise
+	static void onError(j_common_ptr info)
+	{
+		std::longjmp(((ErrorManager *)info->err)->jump, 1);
+	}
+
+	static void onMessage(j_common_ptr)
+	{
+	}
+
+	void start(span<const uint8_t> jpeg, const int scale, const J_DCT_METHOD dct)
+	{
+		jpeg_mem_src(&info, jpeg.data(), (unsigned long)jpeg.size());
+		jpeg_read_header(&info, TRUE);
+		size = cv::Size((int)info.image_width, (int)info.image_height);
+		info.out_color_space = JCS_EXT_BGR;
+		info.scale_num = 1;
+		info.scale_denom = scale;
+		info.dct_method = dct;
+		jpeg_start_decompress(&info);
+	}
+
+public:
+	JpegDecoder()
+	{
+		info.err = jpeg_std_error(&error.manager);
+		error.manager.error_exit = onError;
+		error.manager.output_message = onMessage;
+		jpeg_create_decompress(&info);
+	}
+
+	// full resolution of the last image decoded
+	const cv::Size &imageSize() const
+	{
+		return size;
+	}
+
+	// the whole image at 1 / scale of its size, scale is 1, 2, 4 or 8
+	bool decode(span<const uint8_t> jpeg, const int scale, cv::Mat &bgr)
+	{
+		if (setjmp(error.jump))
+		{
+			jpeg_abort_decompress(&info);
+			return false;
+		}
+
+		// the fast integer DCT is plenty for finding LEDs
+		start(jpeg, scale, scale > 1 ? JDCT_IFAST : JDCT_ISLOW);
+		bgr.create(info.output_height, info.output_width, CV_8UC3);
+		while (info.output_scanline < info.output_height)
+		{
+			JSAMPROW row = bgr.ptr<uint8_t>(info.output_scanline);
+			jpeg_read_scanlines(&info, &row, 1);
+		}
+		jpeg_finish_decompress(&info);
+		return true;
+	}
+
+	/*
+		Full resolution pixels of every region in one pass from the top of the image. Huffman
+		data can only be read in order, so decoding each region on its own would entropy
+		decode everything above it again for every region.
+
+		decoded is where bgr is in the image and contains all regions, rows of it that no
+		region covers are not filled. bgr stays valid until the next call.
+	*/
+	bool decodeRegions(span<const uint8_t> jpeg, span<const cv::Rect> regions, cv::Mat &bgr, cv::Rect &decoded)
+	{
+		if (regions.empty())
+			return false;
+
+		if (setjmp(error.jump))
+		{
+			jpeg_abort_decompress(&info);
+			return false;
+		}
+
+		start(jpeg, 1, JDCT_ISLOW);
+		cv::Rect all = regions[0];
+		for (const cv::Rect &region : regions)
+			all |= region;
+		all &= cv::Rect(0, 0, size.width, size.height);
+
+		// the left edge moves to a block boundary and the width grows to match, one more
+		// column on each side because the outermost ones are upsampled without their neighbours
+		JDIMENSION x = std::max(all.x - 1, 0);
+		JDIMENSION width = std::min(all.x + all.width + 1, size.width) - x;
+		jpeg_crop_scanline(&info, &x, &width);
+		const int left = x > 0 ? 1 : 0;
+		const int right = (int)(x + width) < size.width ? 1 : 0;
+
+		if ((int)_needed.size() < all.height)
+			_needed.resize(all.height);
+		std::fill_n(_needed.begin(), all.height, 0);
+		for (const cv::Rect &region : regions)
+		{
+			const cv::Rect inside = region & all;
+			std::fill_n(_needed.begin() + (inside.y - all.y), inside.height, 1);
+		}
+
+		const int y1 = all.y + all.height;
+		fitView(rowsStorage, rows, cv::Size((int)width, all.height), CV_8UC3);
+		jpeg_skip_scanlines(&info, all.y);
+		while ((int)info.output_scanline < y1)
+		{
+			const int row = (int)info.output_scanline - all.y;
+			if (!_needed[row])
+			{
+				int gap = 1;
+				while (row + gap < all.height && !_needed[row + gap])
+					gap++;
+				jpeg_skip_scanlines(&info, gap);
+				continue;
+			}
+			JSAMPROW out = rows.ptr<uint8_t>(row);
+			jpeg_read_scanlines(&info, &out, 1);
+		}
+
+		// the rest of the image is never needed
+		jpeg_abort_decompress(&info);
+		decoded = cv::Rect((int)x + left, all.y, (int)width - left - right, all.height);
+		bgr = rows(cv::Rect(left, 0, decoded.width, decoded.height));
+		return true;
+	}
+
+	~JpegDecoder()
+	{
+		jpeg_destroy_decompress(&info);
+	}
+};
+
+/*
+	Turns the MJPEG frames of another source into reduced scale bgr frames. The compressed
+	data stays in the frame so whoever needs full resolution can decode just the parts they
+	need with JpegDecoder::decodeRegions.
+
+	With more than one thread consecutive frames are decoded in parallel, frame i by worker
+	i % threads, and still come out in order. That raises throughput but not latency, a frame
+	still takes one decode to come out.
+*/
+class MjpegDecodeSource : public FrameSource
+{
+private:
+	struct Worker
+	{
+		enum State
+		{
+			IDLE = 0,
+			WORKING = 1,
+			DONE = 2,
+			STOP = 3,
+		};
+
+		JpegDecoder decoder;
+		Frame frame;
+		bool decoded = false;
+		atomic<int> state{IDLE};
+		thread worker;
+	};
+
+	unique_ptr<FrameSource> source;
+	const int scale;
+	vector<unique_ptr<Worker>> workers;
+	JpegDecoder decoder;
+
+	// next worker to hand out a frame and next frame to return
+	size_t submitted = 0;
+	size_t returned = 0;
+	bool finished = false;
+
+	Frame compressed;
+
+private:
+	// the compressed data has to outlive the driver buffer it came in
+	bool readCompressed(Frame &frame)
+	{
+		if (!source->read(compressed))
+			return false;
+
+		const uint8_t *data = compressed.image.ptr<uint8_t>();
+		frame.encoded = std::make_shared<const vector<uint8_t>>(data, data + compressed.image.total());
+		frame.captured = compressed.captured;
+		frame.sequence = compressed.sequence;
+		compressed.buffer.reset();
+		return true;
+	}
+
+	bool decode(JpegDecoder &jpeg, Frame &frame)
+	{
+		if (!jpeg.decode(*frame.encoded, scale, frame.image))
+			return false;
+		frame.format = PixelFormat::BGR;
+		frame.scale = scale;
+		frame.fullSize = jpeg.imageSize();
+		return true;
+	}
+
+	static void work(MjpegDecodeSource *self, Worker *w)
+	{
+		while (true)
+		{
+			int state;
+			while ((state = w->state.load()) != Worker::WORKING && state != Worker::STOP)
+				w->state.wait(state);
+			if (state == Worker::STOP)
+				return;
+			w->decoded = self->decode(w->decoder, w->frame);
+			w->state.store(Worker::DONE);
+			w->state.notify_all();
+		}
+	}
+
+	// hands frames to idle workers until all of them are busy
+	void submit()
+	{
+		while (!finished)
+		{
+			Worker &w = *workers[submitted % workers.size()];
+			if (w.state.load() != Worker::IDLE)
+				return;
+			if (!readCompressed(w.frame))
+			{
+				finished = true;
+				return;
+			}
+			submitted++;
+			w.state.store(Worker::WORKING);
+			w.state.notify_all();
+		}
+	}
+
+public:
+	// scale is 1, 2, 4 or 8, threads <= 1 decodes on the thread that reads
+	MjpegDecodeSource(unique_ptr<FrameSource> source, const int scale, const int threads = 1)
+		: source(std::move(source)),
+		  scale(scale)
+	{
+		for (int i = 0; i < threads && threads > 1; i++)
+		{
+			workers.push_back(std::make_unique<Worker>());
+			workers.back()->worker = thread(&MjpegDecodeSource::work, this, workers.back().get());
+		}
+	}
+
+	bool live() const override
+	{
+		return source->live();
+	}
+
+	bool read(Frame &frame) override
+	{
+		if (workers.empty())
+		{
+			while (readCompressed(frame))
+			{
+				// a broken frame is skipped, the next one is probably fine
+				if (decode(decoder, frame))
+					return true;
+			}
+			return false;
+		}
+
+		while (true)
+		{
+			submit();
+			if (returned == submitted)
+				return false;
+
+			Worker &w = *workers[returned % workers.size()];
+			w.state.wait(Worker::WORKING);
+			returned++;
+
+			const bool decoded = w.decoded;
+			if (decoded)
+				std::swap(frame, w.frame);
+			w.state.store(Worker::IDLE);
+			if (decoded)
+				return true;
+		}
+	}
+
+	~MjpegDecodeSource()
+	{
+		for (unique_ptr<Worker> &w : workers)
+		{
+			w->state.wait(Worker::WORKING);
+			w->state.store(Worker::STOP);
+			w->state.notify_all();
+			w->worker.join();
+		}
+	}
+};
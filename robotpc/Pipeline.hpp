@@ -0,0 +1,148 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Point.hpp"
+#include "SPSCQueue.hpp"
+
+using std::atomic;
+using std::string;
+using std::thread;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+// where a robot was found in a frame
+struct RobotObservation
+{
+	uint8_t uid;
+	Point3D center;
+	Point3D front;
+	Point2D centerPixel;
+	Point2D frontPixel;
+};
+
+// what the detect stage of a camera found in one frame, reused from frame to frame
+// the image stays with the detect stage, only the renderer gets a copy of it
+struct FrameJob
+{
+	vector<RobotObservation> robots;
+	uint64_t sequence;
+	time_point<steady_clock> captured;
+	time_point<steady_clock> detected;
+};
+
+struct StageStats
+{
+	uint64_t items;
+
+	// time spent working, waiting for input and waiting for room in the output
+	float busySeconds;
+	float waitSeconds;
+	float blockedSeconds;
+
+	// fraction of time the stage was working, the stage closest to 1 limits the frame rate
+	float occupancy() const
+	{
+		const float total = busySeconds + waitSeconds + blockedSeconds;
+		return total > 0.f ? busySeconds / total : 0.f;
+	}
+
+	float secondsPerItem() const
+	{
+		return items ? busySeconds / items : 0.f;
+	}
+};
+
+/*
+	A thread that repeatedly runs one step of the pipeline. The step reports how long it
+	waited for input, worked and waited for output through measure, so every stage can be
+	compared with the others.
+*/
+class PipelineStage
+{
+public:
+	enum Phase
+	{
+		WAIT = 0,
+		BUSY = 1,
+		BLOCKED = 2,
+	};
+
+private:
+	string name;
+	thread worker;
+	atomic<uint64_t> items{0};
+	atomic<uint64_t> phaseNs[3] = {0, 0, 0};
+
+	PipelineStage(const PipelineStage &) = delete;
+	PipelineStage &operator=(const PipelineStage &) = delete;
+
+public:
+	PipelineStage(const string &name)
+		: name(name)
+	{
+	}
+
+	// runs step once on the calling thread, for stages that must stay on a given thread
+	template <class Step>
+	bool runOnce(Step &step)
+	{
+		if (!step(*this))
+			return false;
+		items.fetch_add(1);
+		return true;
+	}
+
+	// runs step on a new thread until it returns false
+	template <class Step>
+	void start(Step step)
+	{
+		worker = thread([this, step]() mutable
+						{ while (runOnce(step)); });
+	}
+
+	// runs f and accounts its duration to phase
+	template <class F>
+	auto measure(const Phase phase, F f)
+	{
+		const time_point<steady_clock> start = steady_clock::now();
+		auto result = f();
+		phaseNs[phase].fetch_add(std::chrono::duration_cast<nanoseconds>(steady_clock::now() - start).count());
+		return result;
+	}
+
+	void join()
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+
+	const string &getName() const
+	{
+		return name;
+	}
+
+	StageStats stats() const
+	{
+		return {
+			.items = items.load(),
+			.busySeconds = phaseNs[BUSY].load() * 1e-9f,
+			.waitSeconds = phaseNs[WAIT].load() * 1e-9f,
+			.blockedSeconds = phaseNs[BLOCKED].load() * 1e-9f,
+		};
+	}
+
+	~PipelineStage()
+	{
+		join();
+	}
+};
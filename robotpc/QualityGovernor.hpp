@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "Locator.hpp"
+
+using std::array;
+using std::atomic;
+
+// everything the governor turns, one step of its ladder
+struct QualityLevel
+{
+	DetectionMode detection;
+	int pyramidScale;
+	// search windows of MarkerTracker are scaled by this
+	float windowScale;
+	// while a robot is lost the whole frame is searched once every fullScanEvery frames
+	int fullScanEvery;
+	// LocatorParams::refreshFrames
+	int refreshFrames;
+};
+
+struct GovernorStats
+{
+	int level;
+	// smoothed work per frame and what it has to stay below
+	float frameSeconds;
+	float budgetSeconds;
+	uint64_t downgrades;
+	uint64_t upgrades;
+};
+
+/*
+	Holds the detect loop of a camera to a time budget per frame by trading detection
+	quality for speed, one step of LADDER at a time.
+
+	Work per frame is smoothed. Once it stayed above the budget for DOWN_FRAMES frames the
+	next cheaper level is taken, once it stayed below HEADROOM of the budget for upFrames
+	frames the next better one. A level that was left for being too slow right after it was
+	taken has to wait twice as long before it is tried again, so the governor does not
+	bounce between two levels. Every change waits for the frames to show its effect.
+*/
+class QualityGovernor
+{
+public:
+	inline static const array<QualityLevel, 5> LADDER = {{
+		{DetectionMode::FULL, 2, 1.f, 1, 30},
+		{DetectionMode::PYRAMID, 2, 1.f, 1, 30},
+		{DetectionMode::PYRAMID, 4, 0.85f, 2, 60},
+		{DetectionMode::PYRAMID, 4, 0.7f, 4, 90},
+		{DetectionMode::PYRAMID, 4, 0.6f, 8, 120},
+	}};
+
+private:
+	inline static const float LAMBDA = 0.2f;
+	inline static const float HEADROOM = 0.6f;
+	inline static const int DOWN_FRAMES = 5;
+	inline static const int UP_FRAMES = 30;
+	inline static const int MAX_UP_FRAMES = 960;
+
+	const float budget;
+	int level;
+	int upFrames = UP_FRAMES;
+
+	float smoothed = 0.f;
+	int over = 0;
+	int under = 0;
+	// frames since the last upgrade, a downgrade soon after it means it did not fit
+	int sinceUpgrade = MAX_UP_FRAMES;
+
+	// written by the loop thread only, atomic so stats can be read from any thread
+	atomic<int> publishedLevel;
+	atomic<float> frameSeconds{0.f};
+	atomic<uint64_t> downgrades{0};
+	atomic<uint64_t> upgrades{0};
+
+	QualityGovernor(const QualityGovernor &) = delete;
+	QualityGovernor &operator=(const QualityGovernor &) = delete;
+
+private:
+	void change(const int to)
+	{
+		level = to;
+		over = 0;
+		under = 0;
+		smoothed = 0.f;
+		publishedLevel.store(level);
+	}
+
+public:
+	// budgetSeconds <= 0 never changes the level
+	QualityGovernor(const float budgetSeconds, const int startLevel = 1)
+		: budget(budgetSeconds),
+		  level(startLevel),
+		  publishedLevel(startLevel)
+	{
+	}
+
+	// the level in effect for the next frame
+	const QualityLevel &quality() const
+	{
+		return LADDER[level];
+	}
+
+	// call with the work of every frame, true when the level changed
+	bool observe(const float seconds)
+	{
+		smoothed = smoothed > 0.f ? seconds * LAMBDA + (1.f - LAMBDA) * smoothed : seconds;
+		frameSeconds.store(smoothed);
+		sinceUpgrade++;
+		if (budget <= 0.f)
+			return false;
+
+		over = smoothed > budget ? over + 1 : 0;
+		under = smoothed < budget * HEADROOM ? under + 1 : 0;
+
+		if (over >= DOWN_FRAMES && level + 1 < (int)LADDER.size())
+		{
+			if (sinceUpgrade < upFrames)
+				upFrames = std::min(upFrames * 2, MAX_UP_FRAMES);
+			downgrades.fetch_add(1);
+			change(level + 1);
+			return true;
+		}
+		if (under >= upFrames && level > 0)
+		{
+			upgrades.fetch_add(1);
+			sinceUpgrade = 0;
+			change(level - 1);
+			return true;
+		}
+		return false;
+	}
+
+	GovernorStats stats() const
+	{
+		return {
+			.level = publishedLevel.load(),
+			.frameSeconds = frameSeconds.load(),
+			.budgetSeconds = budget,
+			.downgrades = downgrades.load(),
+			.upgrades = upgrades.load(),
+		};
+	}
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "Pipeline.hpp"
+#include "TripleBuffer.hpp"
+
+using std::atomic;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+// what the display thread needs to draw one frame
+struct RenderFrame
+{
+	cv::Mat image;
+	vector<RobotObservation> robots;
+	time_point<steady_clock> captured;
+};
+
+/*
+	Hands frames from the detection thread to the display thread at a capped rate.
+
+	The producer asks due() before doing any work for the display, so frames that would not
+	be shown are never copied. Frames travel through a triple buffer, neither side waits for
+	the other and the display always gets the newest one.
+*/
+class Renderer
+{
+private:
+	TripleBuffer<RenderFrame> buffer;
+	const float minPeriod;
+
+	// producer side
+	time_point<steady_clock> lastSubmit;
+
+	atomic<uint64_t> shown{0};
+
+public:
+	Renderer(const float maxHz)
+		: minPeriod(maxHz > 0.f ? 1.f / maxHz : 0.f)
+	{
+	}
+
+	// ======================= producer =======================
+
+	// true if the display wants a new frame
+	bool due(const time_point<steady_clock> now) const
+	{
+		return duration<float>(now - lastSubmit).count() >= minPeriod;
+	}
+
+	// fill it and call submit
+	RenderFrame &slot()
+	{
+		return buffer.writeSlot();
+	}
+
+	void submit(const time_point<steady_clock> now)
+	{
+		buffer.publish();
+		lastSubmit = now;
+	}
+
+	// ======================= consumer =======================
+
+	// the newest frame if there is one that was not shown yet, valid until the next call
+	RenderFrame *take()
+	{
+		if (!buffer.acquire())
+			return nullptr;
+		shown.fetch_add(1);
+		return &buffer.readSlot();
+	}
+
+	uint64_t framesShown() const
+	{
+		return shown.load();
+	}
+};
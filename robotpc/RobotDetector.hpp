@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Locator.hpp"
+#include "Pipeline.hpp"
+#include "QualityGovernor.hpp"
+
+using std::string;
+using std::vector;
+
+enum class DetectorBackend
+{
+	// front and center LEDs of registered colors, ColorDetector
+	COLOR,
+	// one square marker per robot whose bits are its uid, FiducialDetector
+	FIDUCIAL,
+};
+
+/*
+	Finds robots in the current frame of a Locator. A backend keeps whatever it tracks from
+	frame to frame, the Locator gives it the frame, its worker threads and the floor
+	projection. quality is what the QualityGovernor allows this frame, backends use the parts
+	that mean something to them.
+*/
+class RobotDetector
+{
+public:
+	virtual ~RobotDetector() = default;
+
+	virtual string name() const = 0;
+
+	// robots found in the frame of the last Locator::newFrame, in the floor coordinates of its camera
+	virtual void detect(Locator &l, const QualityLevel &quality, vector<RobotObservation> &robots) = 0;
+
+	// writes what the backend learned while running to path, false when it has nothing to write
+	virtual bool exportSettings(const Locator &, const string &) const
+	{
+		return false;
+	}
+};
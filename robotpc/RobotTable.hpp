@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "FloorProjection.hpp"
+#include "Pipeline.hpp"
+
+using std::atomic;
+using std::lock_guard;
+using std::mutex;
+using std::optional;
+using std::span;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::chrono::time_point;
+
+// a robot as all cameras that saw it agree, in arena coordinates
+struct FusedRobot
+{
+	uint8_t uid;
+	Point3D center;
+	Point3D front;
+	// the newest capture time that went into it
+	time_point<steady_clock> captured;
+	int cameras;
+};
+
+/*
+	Where every robot is in arena coordinates, written by the detect thread of every camera
+	and read by control.
+
+	Each camera keeps only its newest observation of a uid. A robot seen by more than one
+	camera is fused from the observations captured within FUSE_SECONDS of the newest one,
+	older ones describe where the robot was and are left out. Cameras see robots closer to
+	them with more pixels, so observations are weighted by 1 / (1 + r^2) with r the distance
+	from the camera on the floor.
+*/
+class RobotTable
+{
+private:
+	inline static const float FUSE_SECONDS = 0.05f;
+
+	// observations older than this are forgotten, the robot left the view
+	inline static const float STALE_SECONDS = 0.5f;
+
+	struct Observation
+	{
+		Point3D center;
+		Point3D front;
+		time_point<steady_clock> captured;
+		float weight;
+		bool valid = false;
+	};
+
+	const int cameras;
+	vector<CameraPlacement> placements;
+
+	mutex m;
+	// uid * cameras + camera
+	vector<Observation> observations;
+	// newest capture time submitted
+	time_point<steady_clock> newest;
+
+	// changes on every submit and on close
+	atomic<uint64_t> version{0};
+	atomic<bool> closed{false};
+
+	RobotTable(const RobotTable &) = delete;
+	RobotTable &operator=(const RobotTable &) = delete;
+
+public:
+	RobotTable(span<const CameraPlacement> placements)
+		: cameras((int)placements.size()),
+		  placements(placements.begin(), placements.end()),
+		  observations(256 * placements.size())
+	{
+	}
+
+	// robots camera found in a frame captured at captured, in the floor coordinates of that camera
+	void submit(const int camera, const time_point<steady_clock> captured, span<const RobotObservation> robots)
+	{
+		const CameraPlacement &placement = placements[camera];
+		{
+			lock_guard<mutex> l(m);
+			newest = std::max(newest, captured);
+			for (const RobotObservation &robot : robots)
+			{
+				Observation &o = observations[(size_t)robot.uid * cameras + camera];
+				o.center = placement.toArena(robot.center);
+				o.front = placement.toArena(robot.front);
+				o.captured = captured;
+				o.weight = 1.f / (1.f + robot.center.x * robot.center.x + robot.center.y * robot.center.y);
+				o.valid = true;
+			}
+		}
+		version.fetch_add(1);
+		version.notify_all();
+	}
+
+	// waits until something changed since version seen, nullopt once closed
+	optional<uint64_t> wait(const uint64_t seen)
+	{
+		version.wait(seen);
+		if (closed.load())
+			return std::nullopt;
+		return version.load();
+	}
+
+	void close()
+	{
+		closed.store(true);
+		version.fetch_add(1);
+		version.notify_all();
+	}
+
+	/*
+		The clock of the table is the capture time of the newest frame any camera submitted.
+		Frames of unpaced replays carry their recorded time, not the time they were processed
+		at, so staleness is measured on it rather than on steady_clock::now().
+	*/
+	time_point<steady_clock> latest()
+	{
+		lock_guard<mutex> l(m);
+		return newest;
+	}
+
+	void fused(const time_point<steady_clock> now, vector<FusedRobot> &robots)
+	{
+		robots.clear();
+		lock_guard<mutex> l(m);
+		for (int uid = 0; uid < 256; uid++)
+		{
+			Observation *row = &observations[(size_t)uid * cameras];
+
+			optional<time_point<steady_clock>> newest;
+			for (int camera = 0; camera < cameras; camera++)
+			{
+				Observation &o = row[camera];
+				if (o.valid && duration<float>(now - o.captured).count() > STALE_SECONDS)
+					o.valid = false;
+				if (o.valid && (!newest || o.captured > newest.value()))
+					newest = o.captured;
+			}
+			if (!newest)
+				continue;
+
+			Point3D center(0.f, 0.f, 0.f);
+			Point3D front(0.f, 0.f, 0.f);
+			float weights = 0.f;
+			int used = 0;
+			for (int camera = 0; camera < cameras; camera++)
+			{
+				const Observation &o = row[camera];
+				if (!o.valid || duration<float>(newest.value() - o.captured).count() > FUSE_SECONDS)
+					continue;
+				center = center + o.center * o.weight;
+				front = front + o.front * o.weight;
+				weights += o.weight;
+				used++;
+			}
+
+			robots.push_back({
+				.uid = (uint8_t)uid,
+				.center = center * (1.f / weights),
+				.front = front * (1.f / weights),
+				.captured = newest.value(),
+				.cameras = used,
+			});
+		}
+	}
+};
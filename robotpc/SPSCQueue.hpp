@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::atomic;
+using std::vector;
+
+/*
+	Bounded lock free queue for exactly one producer thread and one consumer thread.
+
+	push waits while the queue is full and pop waits while it is empty, both give up once
+	the queue is closed. Waiting uses atomic wait/notify on a signal counter that changes on
+	every push, pop and close.
+*/
+template <class T>
+class SPSCQueue
+{
+private:
+	vector<T> slots;
+
+	// next slot to pop, written by the consumer
+	atomic<size_t> head{0};
+
+	// next slot to push, written by the producer
+	atomic<size_t> tail{0};
+
+	atomic<uint32_t> signal{0};
+	atomic<bool> closed{false};
+
+	SPSCQueue(const SPSCQueue &) = delete;
+	SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+private:
+	void notify()
+	{
+		signal.fetch_add(1, std::memory_order_release);
+		signal.notify_all();
+	}
+
+public:
+	SPSCQueue(const size_t capacity)
+		: slots(capacity + 1)
+	{
+	}
+
+	size_t capacity() const
+	{
+		return slots.size() - 1;
+	}
+
+	size_t size() const
+	{
+		const size_t h = head.load(std::memory_order_acquire);
+		const size_t t = tail.load(std::memory_order_acquire);
+		return t >= h ? t - h : t + slots.size() - h;
+	}
+
+	bool tryPush(const T &item)
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		const size_t next = (t + 1) % slots.size();
+		if (next == head.load(std::memory_order_acquire))
+			return false;
+
+		slots[t] = item;
+		tail.store(next, std::memory_order_release);
+		notify();
+		return true;
+	}
+
+	bool tryPop(T &item)
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+
+		item = slots[h];
+		head.store((h + 1) % slots.size(), std::memory_order_release);
+		notify();
+		return true;
+	}
+
+	// false if the queue got closed before there was room
+	bool push(const T &item)
+	{
+		while (true)
+		{
+			const uint32_t seen = signal.load(std::memory_order_acquire);
+			if (closed.load())
+				return false;
+			if (tryPush(item))
+				return true;
+			signal.wait(seen);
+		}
+	}
+
+	// false if the queue got closed while empty
+	bool pop(T &item)
+	{
+		while (true)
+		{
+			const uint32_t seen = signal.load(std::memory_order_acquire);
+			if (tryPop(item))
+				return true;
+			if (closed.load())
+				return false;
+			signal.wait(seen);
+		}
+	}
+
+	// wakes up and fails all waiting and future pushes, pops fail once the queue is empty
+	void close()
+	{
+		closed.store(true);
+		notify();
+	}
+};
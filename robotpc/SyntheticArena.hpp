@@ -0,0 +1,364 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Config.hpp"
+#include "FloorProjection.hpp"
+#include "FrameSource.hpp"
+#include "Pipeline.hpp"
+#include "Utils.hpp"
+
+using std::array;
+using std::cout;
+using std::endl;
+using std::optional;
+using std::pair;
+using std::vector;
+
+struct ArenaParams
+{
+	// the camera, same meaning as in LocatorParams
+	cv::Size size;
+	float zc;
+	float thetaDeg;
+	float d;
+	float sw;
+	float sh;
+	// robots live in arena coordinates, cameras with the same seed but different placements see the same robots
+	CameraPlacement placement = {};
+
+	// robot i has uid i and looks like colors[i], robots beyond the colors are left out
+	int robots = 20;
+	// empty for the robots of Config. Leds get the color in the middle of their hsv ranges and
+	// front leds with a blinkLength blink their code
+	vector<RobotLEDColors> colors;
+
+	// led radius and distance from the center led to the front led, in m
+	float ledRadius = 0.01f;
+	float ledSpacing = 0.05f;
+
+	// robots drive circles of this radius around where they start, in m and rad/s
+	float wander = 0.05f;
+	float turnRate = 0.5f;
+
+	// gaussian noise added to every channel and blur applied before it, 0 for none
+	float noiseSigma = 0.f;
+	float blurSigma = 0.f;
+
+	// random small colored blobs that are not robots, new ones every frame
+	int distractors = 0;
+
+	// simulated time between frames is 1 / fps, paced sources also sleep that long
+	float fps = 30.f;
+	bool paced = false;
+
+	// 0 never ends
+	uint64_t frames = 0;
+	uint64_t seed = 1;
+};
+
+/*
+	Renders frames of robots on a floor as the camera of LocatorParams would see them, for
+	benchmarking the vision path with more robots than there are.
+
+	Robot poses depend only on the frame sequence number, truth(sequence) gives the poses any
+	frame was rendered with from any thread, without the source having to keep them around.
+	Noise and distractors are seeded per frame, the same parameters always give the same frames.
+
+	The lens has no distortion and leds are flat discs on the floor.
+*/
+class ArenaSource : public FrameSource
+{
+private:
+	struct ArenaRobot
+	{
+		uint8_t uid;
+		Point2D start;
+		float phase;
+		float direction;
+	};
+
+	ArenaParams params;
+	FloorProjection projection;
+	cv::Matx33f floorToPixel;
+	vector<ArenaRobot> arenaRobots;
+	// front and center color of every uid
+	vector<pair<cv::Vec3b, cv::Vec3b>> bgrColors;
+	// where in its blink code every uid was at frame 0, in bits
+	vector<float> blinkStarts;
+	float ledRadiusPixels = 1.f;
+
+	uint64_t sequence = 0;
+	optional<time_point<steady_clock>> next;
+
+	vector<RobotObservation> _truth;
+	cv::Mat _noise;
+
+private:
+	static cv::Vec3b toBGR(const cv::Vec3b hsv)
+	{
+		cv::Mat pixel(1, 1, CV_8UC3, cv::Scalar(hsv[0], hsv[1], hsv[2]));
+		cv::cvtColor(pixel, pixel, cv::COLOR_HSV2BGR);
+		return pixel.at<cv::Vec3b>(0, 0);
+	}
+
+	Point2D toPixel(const Point2D floor) const
+	{
+		const cv::Vec3f p = floorToPixel * cv::Vec3f(floor.x, floor.y, 1.f);
+		return Point2D(p[0] / p[2], p[1] / p[2]);
+	}
+
+	static cv::Vec3b middle(const cv::Vec3b low, const cv::Vec3b high)
+	{
+		return cv::Vec3b((low[0] + high[0]) / 2, (low[1] + high[1]) / 2, (low[2] + high[2]) / 2);
+	}
+
+	// a robot that looks like another one could be either of them to any detector
+	static bool identifiable(const RobotLEDColors &robot, const RobotLEDColors &other)
+	{
+		if (!Config::sameColors(robot, other))
+			return true;
+		return robot.blinkLength > 0 && robot.blinkLength == other.blinkLength &&
+			   BlinkCodes::canonical(robot.blinkBits, robot.blinkLength) != BlinkCodes::canonical(other.blinkBits, other.blinkLength);
+	}
+
+	float seconds(const uint64_t frame) const
+	{
+		return frame / (params.fps > 0.f ? params.fps : 30.f);
+	}
+
+	bool frontOn(const uint8_t uid, const uint64_t frame) const
+	{
+		const RobotLEDColors &colors = params.colors[uid];
+		if (colors.blinkLength == 0)
+			return true;
+		const float bits = blinkStarts[uid] + seconds(frame) / Config::blinkBitSeconds();
+		const int bit = (int)((uint64_t)bits % colors.blinkLength);
+		// msb first
+		return (colors.blinkBits >> (colors.blinkLength - 1 - bit)) & 1u;
+	}
+
+	static cv::Point fixedPoint(const Point2D pixel)
+	{
+		// 4 fractional bits so leds land between pixels like real ones do
+		return cv::Point((int)std::lround(pixel.x * 16.f), (int)std::lround(pixel.y * 16.f));
+	}
+
+	void render(const uint64_t frame, cv::Mat &image)
+	{
+		image.create(params.size, CV_8UC3);
+		image.setTo(cv::Scalar(35, 35, 35));
+
+		cv::RNG rng(params.seed * 0x9E3779B97F4A7C15ull + frame);
+		for (int i = 0; i < params.distractors; i++)
+		{
+			const cv::Point center(rng.uniform(0, params.size.width), rng.uniform(0, params.size.height));
+			const cv::Vec3b color = toBGR(cv::Vec3b((uint8_t)rng.uniform(0, 180), 255, 255));
+			cv::circle(image, center, rng.uniform(1, 5), cv::Scalar(color[0], color[1], color[2]), cv::FILLED, cv::LINE_AA);
+		}
+
+		const int radius = (int)std::lround(ledRadiusPixels * 16.f);
+		truth(frame, _truth);
+		for (const RobotObservation &robot : _truth)
+		{
+			const pair<cv::Vec3b, cv::Vec3b> &color = bgrColors[robot.uid];
+			if (frontOn(robot.uid, frame))
+				cv::circle(image, fixedPoint(robot.frontPixel), radius, cv::Scalar(color.first[0], color.first[1], color.first[2]), cv::FILLED, cv::LINE_AA, 4);
+			cv::circle(image, fixedPoint(robot.centerPixel), radius, cv::Scalar(color.second[0], color.second[1], color.second[2]), cv::FILLED, cv::LINE_AA, 4);
+		}
+
+		if (params.blurSigma > 0.f)
+			cv::GaussianBlur(image, image, cv::Size(), params.blurSigma);
+
+		if (params.noiseSigma > 0.f)
+		{
+			_noise.create(params.size, CV_16SC3);
+			rng.fill(_noise, cv::RNG::NORMAL, 0., params.noiseSigma);
+			cv::add(image, _noise, image, cv::noArray(), CV_8U);
+		}
+	}
+
+public:
+	static vector<RobotLEDColors> configColors()
+	{
+		vector<RobotLEDColors> colors;
+		for (int uid = 0; uid < Config::maxRobotCount(); uid++)
+			colors.push_back(Config::getColors((uint8_t)uid).value());
+		return colors;
+	}
+
+	ArenaSource(const ArenaParams &params)
+		: params(params)
+	{
+		if (this->params.colors.empty())
+			this->params.colors = configColors();
+		for (const RobotLEDColors &color : this->params.colors)
+			bgrColors.emplace_back(toBGR(middle(color.frontLow, color.frontHigh)), toBGR(middle(color.centerLow, color.centerHigh)));
+		if (params.robots > (int)this->params.colors.size())
+			cout << "Arena: only " << this->params.colors.size() << " of " << params.robots << " robots have colors" << endl;
+
+		projection = FloorProjection::fromCamera(params.size, params.zc, degToRad(params.thetaDeg), params.d, params.sw, params.sh);
+		floorToPixel = projection.matrix().inv();
+
+		// start points are spread over the middle of what a camera at the arena origin would see
+		cv::RNG rng(params.seed);
+		for (int i = 0; i < std::min(params.robots, (int)this->params.colors.size()); i++)
+		{
+			const Point2D pixel(
+				rng.uniform(0.1f, 0.9f) * params.size.width,
+				rng.uniform(0.1f, 0.9f) * params.size.height);
+			const Point3D floor = projection.project(pixel).value_or(Point3D(0.f, 0.f));
+			const ArenaRobot robot = {
+				.uid = (uint8_t)i,
+				.start = Point2D(floor.x, floor.y),
+				.phase = rng.uniform(0.f, 2.f * (float)CV_PI),
+				.direction = rng.uniform(0, 2) ? 1.f : -1.f,
+			};
+			blinkStarts.push_back(rng.uniform(0.f, (float)BlinkCodes::MAX_LENGTH));
+
+			// nothing could tell which of the two it is, scoring either would be a guess
+			const RobotLEDColors &colors = this->params.colors[i];
+			if (!std::all_of(arenaRobots.begin(), arenaRobots.end(), [&](const ArenaRobot &other)
+							 { return identifiable(colors, this->params.colors[other.uid]); }))
+			{
+				cout << "Arena: uid " << i << " looks like another robot and is left out" << endl;
+				continue;
+			}
+			arenaRobots.push_back(robot);
+		}
+
+		// leds look the same size everywhere, the one in the middle of the frame decides
+		const Point3D center = projection.project(Point2D(params.size.width * 0.5f, params.size.height * 0.5f)).value_or(Point3D(0.f, 0.f));
+		const Point2D a = toPixel(Point2D(center.x, center.y));
+		const Point2D b = toPixel(Point2D(center.x + params.ledRadius, center.y));
+		ledRadiusPixels = std::max(std::hypot(b.x - a.x, b.y - a.y), 0.5f);
+	}
+
+	// the robots this camera sees in frame sequence, in its floor coordinates
+	void truth(const uint64_t sequence, vector<RobotObservation> &robots) const
+	{
+		const float t = seconds(sequence);
+		robots.clear();
+		for (const ArenaRobot &robot : arenaRobots)
+		{
+			const float angle = robot.phase + robot.direction * params.turnRate * t;
+			const float heading = angle + robot.direction * (float)CV_PI * 0.5f;
+			const Point2D center = robot.start + Point2D(std::cos(angle), std::sin(angle)) * params.wander;
+			const Point2D front = center + Point2D(std::cos(heading), std::sin(heading)) * params.ledSpacing;
+			const Point3D centerCamera = params.placement.toCamera(Point3D(center.x, center.y));
+			const Point3D frontCamera = params.placement.toCamera(Point3D(front.x, front.y));
+
+			// points behind the camera land in the frame too, mirrored, the way back tells them apart
+			const Point2D centerPixel = toPixel(Point2D(centerCamera.x, centerCamera.y));
+			if (centerPixel.x < 0.f || centerPixel.y < 0.f || centerPixel.x >= params.size.width || centerPixel.y >= params.size.height || !projection.project(centerPixel))
+				continue;
+
+			robots.push_back({
+				.uid = robot.uid,
+				.center = centerCamera,
+				.front = frontCamera,
+				.centerPixel = centerPixel,
+				.frontPixel = toPixel(Point2D(frontCamera.x, frontCamera.y)),
+			});
+		}
+	}
+
+	bool live() const override
+	{
+		return params.paced;
+	}
+
+	bool read(Frame &frame) override
+	{
+		if (params.frames > 0 && sequence >= params.frames)
+			return false;
+
+		if (params.paced && params.fps > 0.f)
+		{
+			if (next)
+				std::this_thread::sleep_until(next.value());
+			next = steady_clock::now() + std::chrono::nanoseconds((int64_t)(1e9f / params.fps));
+		}
+
+		render(sequence, frame.image);
+		frame.format = PixelFormat::BGR;
+		frame.buffer.reset();
+		frame.encoded.reset();
+		frame.scale = 1;
+		// unpaced frames carry the simulated time, blink codes and trackers then see fps
+		frame.captured = params.paced ? steady_clock::now() : time_point<steady_clock>(std::chrono::nanoseconds((int64_t)(seconds(sequence) * 1e9)));
+		frame.sequence = sequence++;
+		return true;
+	}
+};
+
+/*
+	How close detections came to the truth. A detection matches the true robot with its uid
+	when it is within maxDistance of it, one at the place of another robot took it for the
+	wrong one and one at no robot at all, or at its robot a second time, is false.
+*/
+struct ArenaScore
+{
+	// in m
+	float maxDistance = 0.03f;
+
+	uint64_t expected = 0;
+	uint64_t matched = 0;
+	uint64_t misidentified = 0;
+	uint64_t falseDetections = 0;
+	double errorSum = 0.;
+	float maxError = 0.f;
+
+	void add(const vector<RobotObservation> &truth, const vector<RobotObservation> &found)
+	{
+		expected += truth.size();
+		// a uid found twice matches once
+		array<bool, 256> taken = {};
+		for (const RobotObservation &robot : found)
+		{
+			const RobotObservation *same = nullptr;
+			float nearest = std::numeric_limits<float>::infinity();
+			for (const RobotObservation &real : truth)
+			{
+				const float distance = std::hypot(robot.center.x - real.center.x, robot.center.y - real.center.y);
+				if (real.uid == robot.uid)
+					same = &real;
+				nearest = std::min(nearest, distance);
+			}
+
+			const float error = same ? std::hypot(robot.center.x - same->center.x, robot.center.y - same->center.y) : nearest;
+			if (same && error < maxDistance)
+			{
+				if (taken[robot.uid])
+				{
+					falseDetections++;
+					continue;
+				}
+				taken[robot.uid] = true;
+				matched++;
+				errorSum += error;
+				maxError = std::max(maxError, error);
+			}
+			else if (nearest < maxDistance)
+				misidentified++;
+			else
+				falseDetections++;
+		}
+	}
+
+	float meanError() const
+	{
+		return matched ? (float)(errorSum / matched) : 0.f;
+	}
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+using std::array;
+using std::atomic;
+
+/*
+	Lock free single producer single consumer buffer that always hands the consumer the
+	newest value.
+
+	The producer writes into its own slot and publishes it by swapping it with the shared
+	middle slot. The consumer takes the middle slot by swapping it with its own. Neither side
+	ever waits for the other and a value the consumer did not take in time is overwritten.
+*/
+template <class T>
+class TripleBuffer
+{
+private:
+	static constexpr uint8_t INDEX_MASK = 0x3;
+	static constexpr uint8_t FRESH = 0x4;
+
+	array<T, 3> slots;
+	atomic<uint8_t> middle{1};
+
+	// owned by the producer
+	uint8_t back = 0;
+
+	// owned by the consumer
+	uint8_t front = 2;
+
+public:
+	// the slot the producer may write into
+	T &writeSlot()
+	{
+		return slots[back];
+	}
+
+	// makes the write slot visible to the consumer, returns true if an unread value got overwritten
+	bool publish()
+	{
+		const uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+		back = previous & INDEX_MASK;
+		return previous & FRESH;
+	}
+
+	bool hasFresh() const
+	{
+		return middle.load(std::memory_order_acquire) & FRESH;
+	}
+
+	// takes the newest published value if there is one the consumer has not seen
+	bool acquire()
+	{
+		if (!hasFresh())
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	// the slot the consumer may read, stays valid until the next successful acquire
+	T &readSlot()
+	{
+		return slots[front];
+	}
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <cmath>
 #include <iostream>
 #include <array>
 #include <map>
@@ -57,6 +58,16 @@ private:
 		}
 	}
 
+	// a blinking front led gets its pattern instead of a plain color
+	void sendLEDs(const RobotLEDColors &colors, sockaddr_storage *to)
+	{
+		s.write(colors.center.toBytes(), to);
+		if (colors.blinkLength > 0)
+			s.write(LEDPattern(colors.front, colors.blinkBits, colors.blinkLength, (uint16_t)std::lround(Config::blinkBitSeconds() * 1000.f)).toBytes(), to);
+		else
+			s.write(colors.front.toBytes(), to);
+	}
+
 private:
 	void handleHeartbeat(UDPPacket<200> &incomingData)
 	{
@@ -108,8 +119,7 @@ private:
 		if (!colors)
 			return;
 
-		s.write(colors.value().center.toBytes(), &incomingData.from);
-		s.write(colors.value().front.toBytes(), &incomingData.from);
+		sendLEDs(colors.value(), &incomingData.from);
 
 		lock_guard<mutex> l(uid_to_robot_mutex);
 		if (uid_to_robot_map.contains(uid))
@@ -144,8 +154,7 @@ private:
 		}
 
 		s.write(WhoAmI(uid.value()).toBytes(), &incomingData.from);
-		s.write(colors.value().center.toBytes(), &incomingData.from);
-		s.write(colors.value().front.toBytes(), &incomingData.from);
+		sendLEDs(colors.value(), &incomingData.from);
 
 		lock_guard<mutex> l(uid_to_robot_mutex);
 		if (uid_to_robot_map.contains(uid.value()))
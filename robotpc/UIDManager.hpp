@@ -20,7 +20,7 @@ public:
 
     optional<uint8_t> getFirstAvailable()
     {
-        for (uint8_t i = 0; i < uids.size(); i++)
+        for (size_t i = 0; i < uids.size(); i++)
         {
             if (!uids[i])
             {
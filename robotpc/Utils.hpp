@@ -1,5 +1,7 @@
 #pragma once
 
+#include <opencv2/opencv.hpp>
+#include <algorithm>
 #include <numbers>
 
 using std::numbers::pi;
@@ -13,3 +15,13 @@ inline float degToRad(const double deg)
 {
 	return float(deg * pi / 180.);
 }
+
+// makes view a size part of storage, storage is only reallocated when it is too small, so a
+// buffer whose size changes from call to call stops allocating once it is large enough.
+// create on view with the same size and type does nothing after that
+inline void fitView(cv::Mat &storage, cv::Mat &view, const cv::Size size, const int type)
+{
+	if (storage.type() != type || storage.rows < size.height || storage.cols < size.width)
+		storage.create(std::max(storage.rows, size.height), std::max(storage.cols, size.width), type);
+	view = storage(cv::Rect(0, 0, size.width, size.height));
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/videodev2.h>
+#include <memory>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "FrameSource.hpp"
+
+using std::atomic;
+using std::cout;
+using std::endl;
+using std::optional;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+/*
+	Captures straight from a linux camera driver. Frames point into the driver's mmap'd
+	buffers, nothing is copied or converted, and carry the kernel timestamp of when the
+	driver got them instead of when we did.
+
+	A buffer goes back to the driver once the last Frame holding it lets go. The frame
+	grabber keeps at most three of them, the driver gets the rest. Frames share the device
+	with the source, after an error or when the source is gone streaming stops right away
+	but the buffers stay mapped until the last frame pointing into one is released.
+*/
+class V4L2Source : public FrameSource
+{
+private:
+	inline static const int BUFFER_COUNT = 6;
+
+	// stop waiting when the camera sends nothing for this long
+	inline static const int TIMEOUT_MS = 5000;
+
+	struct Mapping
+	{
+		void *start;
+		size_t length;
+	};
+
+	// the open device and its mapped buffers, owned by the source and by every frame in a buffer
+	struct Device
+	{
+		int fd = -1;
+		vector<Mapping> mappings;
+		// false once streaming stopped, released buffers are not queued again then
+		atomic<bool> streaming{false};
+
+		void requeue(const uint32_t index)
+		{
+			if (!streaming.load())
+				return;
+
+			v4l2_buffer buffer = {};
+			buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buffer.memory = V4L2_MEMORY_MMAP;
+			buffer.index = index;
+			control(fd, VIDIOC_QBUF, &buffer);
+		}
+
+		~Device()
+		{
+			for (const Mapping &m : mappings)
+				munmap(m.start, m.length);
+			if (fd >= 0)
+				::close(fd);
+		}
+	};
+
+	shared_ptr<Device> device;
+	PixelFormat format;
+	cv::Size size;
+	size_t bytesPerLine = 0;
+	uint64_t sequence = 0;
+
+	V4L2Source(const V4L2Source &) = delete;
+	V4L2Source &operator=(const V4L2Source &) = delete;
+
+private:
+	static int control(const int fd, const unsigned long request, void *arg)
+	{
+		int result;
+		do
+		{
+			result = ioctl(fd, request, arg);
+		} while (result == -1 && errno == EINTR);
+		return result;
+	}
+
+	bool fail(const string &what)
+	{
+		cout << "V4L2: " << what << ": " << std::strerror(errno) << endl;
+		close();
+		return false;
+	}
+
+	static uint32_t fourcc(const PixelFormat format)
+	{
+		switch (format)
+		{
+		case PixelFormat::NV12:
+			return V4L2_PIX_FMT_NV12;
+		case PixelFormat::MJPEG:
+			return V4L2_PIX_FMT_MJPEG;
+		default:
+			return V4L2_PIX_FMT_YUYV;
+		}
+	}
+
+	bool open(const string &path, const int width, const int height)
+	{
+		device = std::make_shared<Device>();
+		const int fd = device->fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+		if (fd < 0)
+			return fail("cannot open " + path);
+
+		v4l2_format fmt = {};
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		fmt.fmt.pix.width = width;
+		fmt.fmt.pix.height = height;
+		fmt.fmt.pix.pixelformat = fourcc(format);
+		fmt.fmt.pix.field = V4L2_FIELD_NONE;
+		if (control(fd, VIDIOC_S_FMT, &fmt) < 0)
+			return fail("cannot set format");
+		if (fmt.fmt.pix.pixelformat != fourcc(format))
+		{
+			errno = EINVAL;
+			return fail("pixel format not supported");
+		}
+		size = cv::Size(fmt.fmt.pix.width, fmt.fmt.pix.height);
+		bytesPerLine = fmt.fmt.pix.bytesperline;
+
+		v4l2_requestbuffers request = {};
+		request.count = BUFFER_COUNT;
+		request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		request.memory = V4L2_MEMORY_MMAP;
+		if (control(fd, VIDIOC_REQBUFS, &request) < 0 || request.count < 4)
+			return fail("cannot get buffers");
+
+		for (uint32_t i = 0; i < request.count; i++)
+		{
+			v4l2_buffer buffer = {};
+			buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buffer.memory = V4L2_MEMORY_MMAP;
+			buffer.index = i;
+			if (control(fd, VIDIOC_QUERYBUF, &buffer) < 0)
+				return fail("cannot query buffer");
+
+			void *start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+			if (start == MAP_FAILED)
+				return fail("cannot map buffer");
+			device->mappings.push_back({start, buffer.length});
+
+			if (control(fd, VIDIOC_QBUF, &buffer) < 0)
+				return fail("cannot queue buffer");
+		}
+
+		v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (control(fd, VIDIOC_STREAMON, &type) < 0)
+			return fail("cannot start streaming");
+		device->streaming.store(true);
+		return true;
+	}
+
+	// stops streaming, the device is closed and unmapped once no frame holds a buffer
+	void close()
+	{
+		if (!device)
+			return;
+
+		if (device->streaming.exchange(false))
+		{
+			v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			control(device->fd, VIDIOC_STREAMOFF, &type);
+		}
+		device.reset();
+	}
+
+	// the kernel stamps buffers with CLOCK_MONOTONIC, which is what steady_clock reads on linux
+	static time_point<steady_clock> timestamp(const v4l2_buffer &buffer)
+	{
+		if (!(buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC))
+			return steady_clock::now();
+
+		const auto since = std::chrono::seconds(buffer.timestamp.tv_sec) + std::chrono::microseconds(buffer.timestamp.tv_usec);
+		return time_point<steady_clock>(std::chrono::duration_cast<steady_clock::duration>(since));
+	}
+
+public:
+	// format must be YUYV, NV12 or MJPEG
+	V4L2Source(const string &device, const int width, const int height, const PixelFormat format = PixelFormat::YUYV)
+		: format(format)
+	{
+		open(device, width, height);
+	}
+
+	bool isOpen() const
+	{
+		return device != nullptr;
+	}
+
+	bool read(Frame &frame) override
+	{
+		// give back the buffer this frame held before waiting for the next one
+		frame.buffer.reset();
+		if (!device)
+			return false;
+		const int fd = device->fd;
+
+		v4l2_buffer buffer = {};
+		buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buffer.memory = V4L2_MEMORY_MMAP;
+		while (control(fd, VIDIOC_DQBUF, &buffer) < 0)
+		{
+			if (errno != EAGAIN)
+				return fail("cannot dequeue buffer");
+
+			pollfd waitFor = {.fd = fd, .events = POLLIN, .revents = 0};
+			const int ready = poll(&waitFor, 1, TIMEOUT_MS);
+			if (ready == 0)
+			{
+				cout << "V4L2: no frame for " << TIMEOUT_MS << " ms" << endl;
+				return false;
+			}
+			if (ready < 0 && errno != EINTR)
+				return fail("cannot wait for frame");
+		}
+
+		const Mapping &mapping = device->mappings[buffer.index];
+		if (format == PixelFormat::MJPEG)
+			frame.image = cv::Mat(1, (int)buffer.bytesused, CV_8UC1, mapping.start);
+		else if (format == PixelFormat::NV12)
+			frame.image = cv::Mat(size.height * 3 / 2, size.width, CV_8UC1, mapping.start, bytesPerLine);
+		else
+			frame.image = cv::Mat(size.height, size.width, CV_8UC2, mapping.start, bytesPerLine);
+		frame.format = format;
+		frame.buffer = shared_ptr<void>(mapping.start, [device = device, index = buffer.index](void *)
+										{ device->requeue(index); });
+		frame.captured = timestamp(buffer);
+		frame.sequence = sequence++;
+		return true;
+	}
+
+	~V4L2Source()
+	{
+		close();
+	}
+};
+
+/*
+	Plays back raw YUYV or NV12 frames stored one after the other in a file, for example
+	recorded with ffmpeg -f v4l2 ... -f rawvideo. The file is mmap'd and frames point into it
+	exactly like V4L2Source frames point into driver buffers, so the same code runs without a
+	camera.
+
+	Paced playback sleeps 1 / fps between frames. Unpaced playback hands out frames as fast as
+	they are taken and stamps them 1 / fps apart from a fixed epoch, like ReplaySource.
+*/
+class RawFileSource : public FrameSource
+{
+private:
+	shared_ptr<void> mapping;
+	size_t length = 0;
+	size_t frameBytes;
+	size_t frameCount = 0;
+
+	PixelFormat format;
+	cv::Size size;
+	std::chrono::nanoseconds period;
+	bool paced;
+	optional<time_point<steady_clock>> next;
+	uint64_t sequence = 0;
+
+public:
+	// format is YUYV or NV12, fps is the rate the frames were taken at
+	RawFileSource(const string &path, const cv::Size size, const PixelFormat format, const float fps = 30.f, const bool paced = true)
+		: frameBytes(format == PixelFormat::NV12 ? (size_t)size.area() * 3 / 2 : (size_t)size.area() * 2),
+		  format(format),
+		  size(size),
+		  period((int64_t)(1e9f / (fps > 0.f ? fps : 30.f))),
+		  paced(paced)
+	{
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			cout << "Cannot open " << path << endl;
+			return;
+		}
+
+		length = (size_t)lseek(fd, 0, SEEK_END);
+		void *start = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (start == MAP_FAILED)
+		{
+			cout << "Cannot map " << path << endl;
+			return;
+		}
+
+		// frames hold the mapping too, it goes away with the last of them
+		const size_t mapped = length;
+		mapping = shared_ptr<void>(start, [mapped](void *p)
+								   { munmap(p, mapped); });
+		frameCount = length / frameBytes;
+	}
+
+	size_t frames() const
+	{
+		return frameCount;
+	}
+
+	bool live() const override
+	{
+		return paced;
+	}
+
+	bool read(Frame &frame) override
+	{
+		if (sequence >= frameCount)
+			return false;
+
+		if (paced)
+		{
+			if (next)
+				std::this_thread::sleep_until(next.value());
+			next = steady_clock::now() + period;
+		}
+
+		uint8_t *data = (uint8_t *)mapping.get() + sequence * frameBytes;
+		const int rows = format == PixelFormat::NV12 ? size.height * 3 / 2 : size.height;
+		frame.image = cv::Mat(rows, size.width, format == PixelFormat::NV12 ? CV_8UC1 : CV_8UC2, data);
+		frame.format = format;
+		frame.buffer = mapping;
+		frame.captured = paced ? steady_clock::now() : time_point<steady_clock>(period * (int64_t)sequence);
+		frame.sequence = sequence++;
+		return true;
+	}
+};
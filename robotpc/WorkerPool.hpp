@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.hpp"
+
+using std::atomic;
+using std::thread;
+using std::vector;
+
+/*
+	Threads that stay around between frames and split the items of one call to run among
+	themselves. The thread that calls run is worker 0 and works too, so a pool of size 1 has
+	no threads at all and runs everything inline.
+
+	Items are taken one at a time from a shared counter, a worker that finishes early takes
+	the next one instead of waiting for the others. task(worker, item) may keep scratch
+	state per worker, no two items run on the same worker at the same time.
+*/
+class WorkerPool
+{
+private:
+	vector<thread> threads;
+
+	// the task of the current run, called through invoke so no std::function has to be built
+	const void *task = nullptr;
+	void (*invoke)(const void *, int, int) = nullptr;
+	int count = 0;
+	atomic<int> next{0};
+	// the workers count their allocations to the counter of the caller of run
+	AllocationCounter *counter = nullptr;
+
+	// changes when a run starts, threads still working on it
+	atomic<uint64_t> generation{0};
+	atomic<int> pending{0};
+	bool stopping = false;
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+private:
+	void claim(const int worker)
+	{
+		int item;
+		while ((item = next.fetch_add(1)) < count)
+			invoke(task, worker, item);
+	}
+
+	void work(const int worker)
+	{
+		uint64_t seen = 0;
+		while (true)
+		{
+			generation.wait(seen);
+			seen = generation.load();
+			if (stopping)
+				return;
+			{
+				const AllocationCounter::Scope counting(counter);
+				claim(worker);
+			}
+			if (pending.fetch_sub(1) == 1)
+				pending.notify_all();
+		}
+	}
+
+public:
+	// size is the number of workers including the caller of run
+	WorkerPool(const int size = 1)
+	{
+		for (int worker = 1; worker < size; worker++)
+			threads.emplace_back(&WorkerPool::work, this, worker);
+	}
+
+	int size() const
+	{
+		return (int)threads.size() + 1;
+	}
+
+	// runs task(worker, item) for every item below count and returns when all of them are done
+	template <class Task>
+	void run(const int count, const Task &task)
+	{
+		if (threads.empty() || count <= 1)
+		{
+			for (int item = 0; item < count; item++)
+				task(0, item);
+			return;
+		}
+
+		this->task = &task;
+		invoke = [](const void *t, const int worker, const int item)
+		{ (*static_cast<const Task *>(t))(worker, item); };
+		this->count = count;
+		counter = AllocationCounter::attached();
+		next.store(0);
+		pending.store((int)threads.size());
+		generation.fetch_add(1);
+		generation.notify_all();
+
+		claim(0);
+
+		int left;
+		while ((left = pending.load()) > 0)
+			pending.wait(left);
+	}
+
+	~WorkerPool()
+	{
+		stopping = true;
+		generation.fetch_add(1);
+		generation.notify_all();
+		for (thread &t : threads)
+			t.join();
+	}
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+
+// how the pixels of a frame are stored
+enum class PixelFormat
+{
+	// CV_8UC3, what cv::VideoCapture delivers
+	BGR,
+	// CV_8UC2, y0 u y1 v for every two pixels
+	YUYV,
+	// CV_8UC1 with height * 3 / 2 rows, the y plane followed by the interleaved uv plane at half resolution
+	NV12,
+	// CV_8UC1 with one row holding a compressed jpeg, has to go through MjpegDecodeSource first
+	MJPEG,
+};
+
+/*
+	YUV (BT.601 video range, what webcams send) to BGR with the fixed point coefficients of
+	cv::cvtColor, one pixel or one row at a time so frames never need a full BGR copy.
+*/
+class YUVKernel
+{
+private:
+	static constexpr int SHIFT = 20;
+	static constexpr int ROUND = 1 << (SHIFT - 1);
+	static constexpr int CY = 1220542;
+	static constexpr int CUB = 2116026;
+	static constexpr int CUG = -409993;
+	static constexpr int CVG = -852492;
+	static constexpr int CVR = 1673527;
+
+	static uint8_t clamp(const int value)
+	{
+		return (uint8_t)std::clamp(value >> SHIFT, 0, 255);
+	}
+
+	static void pixel(const int y, const int ruv, const int guv, const int buv, uint8_t *bgr)
+	{
+		const int yy = std::max(0, y - 16) * CY;
+		bgr[0] = clamp(yy + buv);
+		bgr[1] = clamp(yy + guv);
+		bgr[2] = clamp(yy + ruv);
+	}
+
+	// two horizontal neighbours share u and v
+	static void pair(const int y0, const int y1, const int u, const int v, uint8_t *bgr)
+	{
+		const int uu = u - 128;
+		const int vv = v - 128;
+		const int ruv = ROUND + CVR * vv;
+		const int guv = ROUND + CVG * vv + CUG * uu;
+		const int buv = ROUND + CUB * uu;
+		pixel(y0, ruv, guv, buv, bgr);
+		pixel(y1, ruv, guv, buv, bgr + 3);
+	}
+
+public:
+	// the size in pixels of an image stored in format
+	static cv::Size size(const cv::Mat &image, const PixelFormat format)
+	{
+		return format == PixelFormat::NV12 ? cv::Size(image.cols, image.rows * 2 / 3) : image.size();
+	}
+
+	// converts count pixels of row y starting at x, x and count must be even for yuv formats
+	static void row(const cv::Mat &image, const PixelFormat format, const int x, const int y, const int count, uint8_t *bgr)
+	{
+		if (format == PixelFormat::BGR)
+		{
+			std::copy_n(image.ptr<uint8_t>(y) + 3 * x, 3 * count, bgr);
+			return;
+		}
+
+		if (format == PixelFormat::YUYV)
+		{
+			const uint8_t *src = image.ptr<uint8_t>(y) + 2 * x;
+			for (int i = 0; i < count; i += 2, src += 4, bgr += 6)
+				pair(src[0], src[2], src[1], src[3], bgr);
+			return;
+		}
+
+		const int height = image.rows * 2 / 3;
+		const uint8_t *luma = image.ptr<uint8_t>(y) + x;
+		const uint8_t *chroma = image.ptr<uint8_t>(height + y / 2) + x;
+		for (int i = 0; i < count; i += 2, luma += 2, chroma += 2, bgr += 6)
+			pair(luma[0], luma[1], chroma[0], chroma[1], bgr);
+	}
+
+	// one pixel from its luma and the chroma it shares with its neighbour
+	static void single(const int y, const int u, const int v, uint8_t *bgr)
+	{
+		const int uu = u - 128;
+		const int vv = v - 128;
+		pixel(y, ROUND + CVR * vv, ROUND + CVG * vv + CUG * uu, ROUND + CUB * uu, bgr);
+	}
+
+	static cv::Vec3b pixel(const cv::Mat &image, const PixelFormat format, const int x, const int y)
+	{
+		uint8_t pair[6];
+		const int even = x & ~1;
+		row(image, format, format == PixelFormat::BGR ? x : even, y, format == PixelFormat::BGR ? 1 : 2, pair);
+		const uint8_t *p = format == PixelFormat::BGR ? pair : pair + 3 * (x - even);
+		return cv::Vec3b(p[0], p[1], p[2]);
+	}
+
+	// luma, or the largest channel for bgr, what brightness comparisons use
+	static uint8_t brightness(const cv::Mat &image, const PixelFormat format, const int x, const int y)
+	{
+		if (format == PixelFormat::YUYV)
+			return image.ptr<uint8_t>(y)[2 * x];
+		if (format == PixelFormat::NV12)
+			return image.ptr<uint8_t>(y)[x];
+		const uint8_t *p = image.ptr<uint8_t>(y) + 3 * x;
+		return std::max(std::max(p[0], p[1]), p[2]);
+	}
+
+	// the whole image as bgr, only for things that need all of it like display
+	static void toBGR(const cv::Mat &image, const PixelFormat format, cv::Mat &bgr)
+	{
+		if (format == PixelFormat::BGR)
+			bgr = image;
+		else if (format == PixelFormat::YUYV)
+			cv::cvtColor(image, bgr, cv::COLOR_YUV2BGR_YUYV);
+		else
+			cv::cvtColor(image, bgr, cv::COLOR_YUV2BGR_NV12);
+	}
+};
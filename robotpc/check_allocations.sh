@@ -0,0 +1,10 @@
+#!/bin/sh
+# Runs the synthetic arena headless with the allocation check on, exits with 1 when a detect
+# thread allocated after its warm up.
+#
+#   robotpc/check_allocations.sh [path of the binary, main next to this script by default]
+
+binary=$(realpath "${1:-$(dirname "$0")/main}") || exit 2
+# robots.yaml is read from the working directory
+cd "$(dirname "$0")" || exit 2
+exec "$binary" --check-allocations
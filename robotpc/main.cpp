@@ -1,6 +1,88 @@
 #include "Locator.hpp"
 #include "UDPRobotServer.hpp"
 #include "UIDManager.hpp"
+#include "Pipeline.hpp"
+#include "Renderer.hpp"
+#include "FrameScheduler.hpp"
+#include "SyntheticArena.hpp"
+#include "RobotTable.hpp"
+#include "QualityGovernor.hpp"
+#include "ColorDetector.hpp"
+#include "FiducialDetector.hpp"
+#include "AllocationCounter.hpp"
+
+#include <csignal>
+#include <cstdlib>
+#include <new>
+
+// every allocation of the program goes through here and is counted to the AllocationCounter
+// of the thread making it, see AllocationCounter.hpp
+void *operator new(const size_t size)
+{
+	AllocationCounter::count();
+	if (void *p = std::malloc(size > 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](const size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(const size_t size, const std::align_val_t alignment)
+{
+	AllocationCounter::count();
+	void *p = nullptr;
+	if (posix_memalign(&p, std::max((size_t)alignment, sizeof(void *)), size > 0 ? size : 1) == 0)
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](const size_t size, const std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
 
 const int resolutions[5][2] = {
 	{2560, 1440},
@@ -11,12 +93,342 @@ const int resolutions[5][2] = {
 };
 const int current_resolution = 1;
 
-int main()
+// every camera gets its own capture and detect thread, camera i is camID i
+const int camera_count = 1;
+
+// where each camera stands in the arena, camera 0 at the origin defines the arena frame
+const CameraPlacement camera_placements[] = {
+	{.x = 0.f, .y = 0.f, .yawDeg = 0.f},
+	{.x = 1.f, .y = 0.f, .yawDeg = 0.f},
+	{.x = 0.f, .y = 1.f, .yawDeg = 0.f},
+	{.x = 1.f, .y = 1.f, .yawDeg = 0.f},
+};
+
+// FrameRecorder files played instead of the cameras, empty ones use the camera
+const char *camera_replays[] = {"", "", "", ""};
+
+static_assert(camera_count <= (int)std::size(camera_placements) && camera_count <= (int)std::size(camera_replays));
+
+// more than 0 replaces the camera with a synthetic arena of that many robots and reports
+// how close the detections came to where the robots really were
+const int arena_robots = 0;
+
+// robots and their colors, the built in ones of Config are used when it cannot be read
+const char *robots_file = "robots.yaml";
+
+// when not empty every camera writes the robots with the color ranges it adapted to on exit,
+// %d is the camera index. Files can be used as robots_file
+const char *adapted_colors_file = "";
+
+// how every camera finds robots, colored LEDs or printed square markers
+const DetectorBackend detector_backend = DetectorBackend::COLOR;
+
+// when not empty the marker of every robot of robots_file is written there as marker_<uid>.png
+// to be printed, nothing else runs
+const char *marker_directory = "";
+
+// when not empty every backend is run on this FrameRecorder file and compared, nothing else runs
+const char *benchmark_replay = "";
+
+// uids that are in every frame of benchmark_replay, empty for every robot of robots_file
+const vector<uint8_t> benchmark_uids = {};
+
+// true runs the benchmark on the synthetic arena of arena_robots instead and scores it against
+// where the robots really were
+const bool benchmark_arena = false;
+
+// work per frame the detect loop of every camera is held to by trading detection quality,
+// 0 keeps the detection of LocatorParams
+const float detect_budget_seconds = 1.f / 30.f;
+
+// how many detected frames of a camera may wait for the robot table
+const int pipeline_depth = 2;
+
+// frames every detect thread may allocate in while its buffers grow, after them a frame
+// should not allocate at all
+const int allocation_warmup_frames = 100;
+
+// exit with 1 when a detect thread allocated after its warm up, for checking a recording or
+// the synthetic arena with the default backend in headless mode. Running with
+// --check-allocations does the same on the synthetic arena, headless, without editing this
+const bool allocation_check = false;
+
+// robots of the synthetic arena of --check-allocations when arena_robots is 0
+const int allocation_check_robots = 8;
+
+// set by ctrl+c, the only way to stop in headless mode
+atomic<bool> interrupted{false};
+
+unique_ptr<RobotDetector> makeDetector(const DetectorBackend backend, Locator &l)
 {
-	UDPRobotServer server;
-	server.start();
+	if (backend == DetectorBackend::FIDUCIAL)
+		return std::make_unique<FiducialDetector>();
+	return std::make_unique<ColorDetector>(l);
+}
 
-	LocatorParams params = {
+// one camera and everything that follows what it sees, each on its own capture and detect thread
+struct Camera
+{
+	int index;
+	unique_ptr<Locator> locator;
+
+	// owned by the locator, the pointer is only for asking where robots were
+	const ArenaSource *arena = nullptr;
+
+	unique_ptr<RobotDetector> detector;
+
+	// jobs go around detect -> toTable -> publish -> freeJobs
+	vector<FrameJob> jobs;
+	SPSCQueue<FrameJob *> freeJobs;
+	SPSCQueue<FrameJob *> toTable;
+
+	Renderer renderer;
+	FrameScheduler scheduler;
+	QualityGovernor governor;
+	// everything the detect thread and the workers of the locator allocate, per frame
+	AllocationCounter allocations;
+	PipelineStage detect;
+	PipelineStage publish;
+
+	// only touched by the publish thread until it is joined
+	ArenaScore score;
+	vector<RobotObservation> truth;
+
+	Camera(const int index, const LocatorParams &params, unique_ptr<FrameSource> source, const ArenaSource *arena)
+		: index(index),
+		  locator(std::make_unique<Locator>(params, std::move(source))),
+		  arena(arena),
+		  detector(makeDetector(detector_backend, *locator)),
+		  jobs(pipeline_depth + 2),
+		  freeJobs(jobs.size()),
+		  toTable(pipeline_depth),
+		  renderer(params.displayHz),
+		  scheduler(params.targetHz),
+		  governor(detect_budget_seconds),
+		  allocations(allocation_warmup_frames),
+		  detect("detect " + to_string(index)),
+		  publish("publish " + to_string(index))
+	{
+		for (FrameJob &job : jobs)
+			freeJobs.tryPush(&job);
+	}
+};
+
+// draws where every robot was found
+void printRobots(const cv::Mat &image, const vector<RobotObservation> &robots)
+{
+	for (const RobotObservation &robot : robots)
+	{
+		Locator::addCircle(image, robot.frontPixel, {0, 255, 0});
+		Locator::addCircle(image, robot.centerPixel, {255, 0, 255});
+		Locator::addLine(image, robot.centerPixel, robot.frontPixel, {0, 255, 0});
+		Locator::addText(image, robot.centerPixel, cv::format("%d r: (%.3f, %.3f)", (int)robot.uid, robot.center.x, robot.center.y), {255, 0, 255}, 30);
+	}
+}
+
+/*
+	The texts below are formatted on the main thread, which is not attached to any
+	AllocationCounter. The allocation counts cover the detect threads and their workers only,
+	drawing and reporting allocate freely.
+*/
+string scheduleText(const ScheduleStats &stats)
+{
+	return cv::format(
+		"late: %llu / %llu (%.1f ms) | period: %.1f ms | jitter: %.2f ms, max %.2f ms",
+		(unsigned long long)stats.late,
+		(unsigned long long)stats.loops,
+		stats.lastOverrunSeconds * 1000.f,
+		stats.periodSeconds * 1000.f,
+		stats.jitterSeconds * 1000.f,
+		stats.maxJitterSeconds * 1000.f);
+}
+
+string governorText(const GovernorStats &stats)
+{
+	const QualityLevel &level = QualityGovernor::LADDER[stats.level];
+	return cv::format(
+		"quality: %d (%s /%d, windows x%.2f, scan 1/%d) | work: %.1f / %.1f ms | down %llu, up %llu",
+		stats.level,
+		level.detection == DetectionMode::FULL ? "full" : "pyramid",
+		level.pyramidScale,
+		level.windowScale,
+		level.fullScanEvery,
+		stats.frameSeconds * 1000.f,
+		stats.budgetSeconds * 1000.f,
+		(unsigned long long)stats.downgrades,
+		(unsigned long long)stats.upgrades);
+}
+
+string allocationText(const AllocationStats &stats)
+{
+	return cv::format(
+		"allocations: %llu last frame | %llu after warm up, most %llu in a frame",
+		(unsigned long long)stats.lastFrame,
+		(unsigned long long)stats.steady,
+		(unsigned long long)stats.worstFrame);
+}
+
+void printStageStats(const cv::Mat &image, const vector<const PipelineStage *> &stages)
+{
+	string text;
+	for (const PipelineStage *stage : stages)
+	{
+		const StageStats stats = stage->stats();
+		text += cv::format("%s: %.0f%% %.1f ms | ", stage->getName().c_str(), stats.occupancy() * 100.f, stats.secondsPerItem() * 1000.f);
+	}
+	Locator::addText(image, Point2D(5, 110), text, cv::Scalar(255, 255, 255));
+}
+
+// the synthetic arena the camera of params sees
+unique_ptr<ArenaSource> makeArena(const LocatorParams &params, const int robots)
+{
+	return std::make_unique<ArenaSource>(ArenaParams{
+		.size = cv::Size(params.width, params.height),
+		.zc = params.zc,
+		.thetaDeg = params.thetaDeg,
+		.d = params.d,
+		.sw = params.sw,
+		.sh = params.sh,
+		.placement = params.placement,
+		.robots = robots,
+		.noiseSigma = 2.f,
+		.blurSigma = 0.7f,
+		.distractors = 10,
+		.frames = 3000});
+}
+
+/*
+	Plays benchmark_replay unpaced and headless through every backend at the same quality and
+	prints how long detection took per frame and how many robots it found. The robots of
+	benchmark_uids, or all of robots_file, are taken to be in every frame, found robots with
+	other uids are counted apart. With benchmark_arena the synthetic arena is played instead
+	and every backend is scored against its truth like the arena of the normal run.
+*/
+void benchmark(const LocatorParams &params)
+{
+	struct Result
+	{
+		string name;
+		uint64_t frames = 0;
+		uint64_t expected = 0;
+		uint64_t found = 0;
+		uint64_t unexpected = 0;
+		float seconds = 0.f;
+		ArenaScore score;
+	};
+
+	array<bool, 256> present = {};
+	if (benchmark_uids.empty())
+		std::fill(present.begin(), present.begin() + Config::maxRobotCount(), true);
+	for (const uint8_t uid : benchmark_uids)
+		present[uid] = true;
+	const uint64_t robotsPerFrame = std::count(present.begin(), present.end(), true);
+
+	const QualityLevel &quality = QualityGovernor::LADDER[1];
+	vector<Result> results;
+	for (const DetectorBackend backend : {DetectorBackend::COLOR, DetectorBackend::FIDUCIAL})
+	{
+		LocatorParams replayParams = params;
+		replayParams.replayPath = benchmark_replay;
+		replayParams.replayPaced = false;
+		replayParams.helper = false;
+		replayParams.display = DisplayMode::HEADLESS;
+		replayParams.targetHz = 0.f;
+
+		const ArenaSource *arena = nullptr;
+		unique_ptr<FrameSource> source;
+		if (benchmark_arena)
+		{
+			unique_ptr<ArenaSource> generated = makeArena(replayParams, arena_robots > 0 ? arena_robots : Config::maxRobotCount());
+			arena = generated.get();
+			source = std::move(generated);
+		}
+		else
+		{
+			source = Locator::makeSource(replayParams);
+		}
+
+		Locator l(replayParams, std::move(source));
+		l.setDetection(quality.detection, quality.pyramidScale, quality.refreshFrames);
+		unique_ptr<RobotDetector> detector = makeDetector(backend, l);
+
+		Result result = {.name = detector->name()};
+		vector<RobotObservation> robots;
+		vector<RobotObservation> truth;
+		while (l.newFrame())
+		{
+			const time_point<steady_clock> begun = steady_clock::now();
+			detector->detect(l, quality, robots);
+			result.seconds += duration<float>(steady_clock::now() - begun).count();
+			result.frames++;
+			if (arena)
+			{
+				arena->truth(l.frameSequence(), truth);
+				result.score.add(truth, robots);
+				continue;
+			}
+
+			result.expected += robotsPerFrame;
+			for (const RobotObservation &robot : robots)
+			{
+				if (present[robot.uid])
+					result.found++;
+				else
+					result.unexpected++;
+			}
+		}
+		results.push_back(result);
+	}
+
+	for (const Result &result : results)
+	{
+		const float ms = result.frames > 0 ? result.seconds * 1000.f / result.frames : 0.f;
+		if (benchmark_arena)
+		{
+			const ArenaScore &score = result.score;
+			cout << cv::format(
+						"%s: %llu frames, %.2f ms per frame, %llu of %llu robots found (%.1f%%), error %.1f mm mean, %llu misidentified, %llu false",
+						result.name.c_str(),
+						(unsigned long long)result.frames,
+						ms,
+						(unsigned long long)score.matched,
+						(unsigned long long)score.expected,
+						score.expected > 0 ? score.matched * 100.f / score.expected : 0.f,
+						score.meanError() * 1000.f,
+						(unsigned long long)score.misidentified,
+						(unsigned long long)score.falseDetections)
+				 << endl;
+			continue;
+		}
+
+		cout << cv::format(
+					"%s: %llu frames, %.2f ms per frame, %llu of %llu robots found (%.1f%%), %llu unexpected",
+					result.name.c_str(),
+					(unsigned long long)result.frames,
+					ms,
+					(unsigned long long)result.found,
+					(unsigned long long)result.expected,
+					result.expected > 0 ? result.found * 100.f / result.expected : 0.f,
+					(unsigned long long)result.unexpected)
+			 << endl;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	// the only argument, everything else is set above
+	const bool checkAllocations = argc == 2 && string(argv[1]) == "--check-allocations";
+	if (argc > 1 && !checkAllocations)
+	{
+		cout << "Usage: " << argv[0] << " [--check-allocations]" << endl;
+		return 2;
+	}
+	const int arenaRobots = checkAllocations && arena_robots == 0 ? allocation_check_robots : arena_robots;
+
+	// before anything asks Config for robots
+	Config::load(robots_file);
+
+	const LocatorParams params = {
 		.camID = 0,
 		.width = resolutions[current_resolution][0],
 		.height = resolutions[current_resolution][1],
@@ -25,45 +437,298 @@ int main()
 		.d = 0.0002f,
 		.sw = 1.5e-6f,
 		.sh = 1.5e-6f,
-		.helper = false};
+		.helper = false,
+		.centroid = CentroidMode::INTENSITY,
+		.detection = DetectionMode::PYRAMID,
+		.pyramidScale = 2,
+		.detectThreads = 4,
+		.changeGating = true,
+		.adaptColors = true,
+		.display = checkAllocations ? DisplayMode::HEADLESS : DisplayMode::WINDOW,
+		.displayHz = 10.f,
+		.targetHz = 0.f};
+
+	if (marker_directory[0] != '\0')
+	{
+		for (int uid = 0; uid < std::min(Config::maxRobotCount(), FiducialCodes::count()); uid++)
+		{
+			const string path = cv::format("%s/marker_%d.png", marker_directory, uid);
+			if (!cv::imwrite(path, FiducialCodes::image(uid, 40)))
+				cout << "Could not write " << path << endl;
+		}
+		return 0;
+	}
+
+	if (benchmark_replay[0] != '\0' || benchmark_arena)
+	{
+		benchmark(params);
+		return 0;
+	}
+
+	UDPRobotServer server;
+	server.start();
+
+	vector<unique_ptr<Camera>> cameras;
+	vector<CameraPlacement> placements;
+	// unpaced replays and arenas stamp frames with recorded or simulated time, staleness is
+	// then measured on the newest frame instead of the wall clock
+	bool recordedTime = false;
+	for (int i = 0; i < camera_count; i++)
+	{
+		LocatorParams cameraParams = params;
+		cameraParams.camID = i;
+		cameraParams.placement = camera_placements[i];
+		cameraParams.replayPath = camera_replays[i];
+		cameraParams.window = cv::format("camera %d", i);
+		cameraParams.helper = params.helper && i == 0;
+		placements.push_back(cameraParams.placement);
+
+		const ArenaSource *arena = nullptr;
+		unique_ptr<FrameSource> source;
+		if (arenaRobots > 0)
+		{
+			unique_ptr<ArenaSource> generated = makeArena(cameraParams, arenaRobots);
+			arena = generated.get();
+			source = std::move(generated);
+		}
+		else
+		{
+			source = Locator::makeSource(cameraParams);
+		}
 
-	Locator l(params);
+		recordedTime = recordedTime || !source->live();
+		cameras.push_back(std::make_unique<Camera>(i, cameraParams, std::move(source), arena));
 
+		// the governor starts from its own level rather than the one of params
+		if (detect_budget_seconds > 0.f)
+		{
+			const QualityLevel &quality = cameras.back()->governor.quality();
+			cameras.back()->locator->setDetection(quality.detection, quality.pyramidScale, quality.refreshFrames);
+		}
+	}
+
+	Locator &first = *cameras.front()->locator;
 	const Point2D frameCenter{0.f, 0.f};
-	const Point3D desiredRobotLocation = l.imagePlaneXYZToFloor(l.imagePlaneUVToImagePlaneXYZ(frameCenter)).value();
+	const Point3D desiredRobotLocation = placements.front().toArena(first.imagePlaneXYZToFloor(first.imagePlaneUVToImagePlaneXYZ(frameCenter)).value());
+
+	/*
+		capture -> detect -> publish for every camera, each on its own threads, -> table -> control
+
+		Every detect thread hands what its camera found to its publish thread through a queue
+		of pipeline_depth jobs. Publish scores it against the arena and writes it to the robot
+		table in arena coordinates. When publish falls behind, detect waits for room and the
+		capture thread drops frames, so latency stays bounded. Control sends commands from the
+		fused table whenever it changed, always from the newest state instead of working
+		through a queue of old ones.
 
-	while (l.again(10))
+		Drawing is not part of it. In window mode each detect thread hands a copy of its frame
+		to its renderer at most displayHz times a second and the main thread draws and shows
+		them, in headless mode nothing is copied or drawn at all.
+	*/
+	RobotTable table(placements);
+
+	const bool windowed = params.display == DisplayMode::WINDOW;
+
+	// the last publish thread to stop closes the table, then control stops too
+	atomic<bool> stopping{false};
+	atomic<int> running{camera_count};
+	atomic<bool> finished{false};
+
+	PipelineStage control("control");
+
+	for (unique_ptr<Camera> &camera : cameras)
 	{
-		if (!l.newFrame())
-			continue;
+		auto detectStep = [&, c = camera.get()](PipelineStage &stage)
+		{
+			const AllocationCounter::Scope counting(&c->allocations);
+			Locator &l = *c->locator;
+			FrameJob *job = nullptr;
+			if (!stage.measure(PipelineStage::WAIT, [&]()
+							   {
+				c->scheduler.waitForSlot();
+				return !stopping.load() && c->freeJobs.pop(job) && l.newFrame(); }))
+			{
+				c->toTable.close();
+				return false;
+			}
 
-		for (uint8_t uid = 0; uid < Config::maxRobotCount(); uid++)
+			stage.measure(PipelineStage::BUSY, [&]()
+						  {
+				const time_point<steady_clock> begun = steady_clock::now();
+				c->scheduler.begin();
+				c->detector->detect(l, c->governor.quality(), job->robots);
+				l.locateHelper();
+				job->sequence = l.frameSequence();
+				job->captured = l.frameTime();
+				job->detected = steady_clock::now();
+
+				if (windowed && c->renderer.due(job->detected))
+				{
+					RenderFrame &render = c->renderer.slot();
+					l.getFrame().copyTo(render.image);
+					render.robots = job->robots;
+					render.captured = job->captured;
+					c->renderer.submit(job->detected);
+				}
+				c->scheduler.end();
+
+				if (c->governor.observe(duration<float>(steady_clock::now() - begun).count()))
+				{
+					const QualityLevel &quality = c->governor.quality();
+					l.setDetection(quality.detection, quality.pyramidScale, quality.refreshFrames);
+				}
+				c->allocations.frameDone();
+				return true; });
+
+			return stage.measure(PipelineStage::BLOCKED, [&]() { return c->toTable.push(job); });
+		};
+
+		auto publishStep = [&, c = camera.get()](PipelineStage &stage)
 		{
-			optional<RobotLEDColors> colors = Config::getColors(uid);
-			if (!colors)
-				continue;
+			FrameJob *job = nullptr;
+			if (!stage.measure(PipelineStage::WAIT, [&]() { return c->toTable.pop(job); }))
+			{
+				if (running.fetch_sub(1) == 1)
+					table.close();
+				return false;
+			}
 
-			optional<Point3D> frontWorld = l.locateMarkAndGet(
-				colors.value().frontLow,
-				colors.value().frontHigh,
-				0.f);
-			if (!frontWorld)
-				continue;
+			stage.measure(PipelineStage::BUSY, [&]()
+						  {
+				if (c->arena)
+				{
+					c->arena->truth(job->sequence, c->truth);
+					c->score.add(c->truth, job->robots);
+				}
+				table.submit(c->index, job->captured, job->robots);
+				return true; });
+
+			// there is room for every job, this never waits
+			return stage.measure(PipelineStage::BLOCKED, [&]() { return c->freeJobs.push(job); });
+		};
+
+		camera->detect.start(detectStep);
+		camera->publish.start(publishStep);
+	}
+
+	vector<FusedRobot> fused;
+	uint64_t seen = 0;
+	auto controlStep = [&](PipelineStage &stage)
+	{
+		const optional<uint64_t> changed = stage.measure(PipelineStage::WAIT, [&]() { return table.wait(seen); });
+		if (!changed)
+		{
+			finished.store(true);
+			return false;
+		}
+		seen = changed.value();
+
+		return stage.measure(PipelineStage::BUSY, [&]()
+							 {
+			table.fused(recordedTime ? table.latest() : steady_clock::now(), fused);
+			for (const FusedRobot &robot : fused)
+			{
+				if (!server.updateKinematics(robot.center, robot.front, robot.uid))
+					cout << "Could not update kinematics: " << (int)robot.uid << endl;
+				if (!server.informRobot(desiredRobotLocation, robot.uid))
+					cout << "Could not inform robot: " << (int)robot.uid << endl;
+			}
+			return true; });
+	};
 
-			optional<Point3D> centerWorld = l.locateMarkAndGet(
-				colors.value().centerLow,
-				colors.value().centerHigh,
-				0.f,
-				RegionOfInterest(l.getPixelXY(), 100, 100));
-			if (!centerWorld)
+	std::signal(SIGINT, [](int) { interrupted.store(true); });
+
+	const time_point<steady_clock> started = steady_clock::now();
+	control.start(controlStep);
+	// the main thread only shows frames and reports, it never paces the pipeline
+	time_point<steady_clock> lastReport = started;
+	while (!interrupted.load() && !finished.load())
+	{
+		if (!windowed)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (steady_clock::now() - lastReport < std::chrono::seconds(5))
 				continue;
+			lastReport = steady_clock::now();
+			for (const unique_ptr<Camera> &camera : cameras)
+			{
+				cout << "camera " << camera->index << ": " << scheduleText(camera->scheduler.stats()) << endl;
+				cout << "camera " << camera->index << ": " << governorText(camera->governor.stats()) << endl;
+				cout << "camera " << camera->index << ": " << allocationText(camera->allocations.stats()) << endl;
+			}
+			continue;
+		}
 
-			if (!server.updateKinematics(centerWorld.value(), frontWorld.value(), uid))
-				cout << "Could not update kinematics: " << (int)uid << endl;
-			if (!server.informRobot(desiredRobotLocation, uid))
-				cout << "Could not inform robot: " << (int)uid << endl;
+		for (unique_ptr<Camera> &camera : cameras)
+		{
+			if (RenderFrame *render = camera->renderer.take())
+			{
+				printRobots(render->image, render->robots);
+				printStageStats(render->image, {&camera->detect, &camera->publish, &control});
+				Locator::addText(render->image, Point2D(5, 140), scheduleText(camera->scheduler.stats()), cv::Scalar(255, 255, 255));
+				Locator::addText(render->image, Point2D(5, 170), governorText(camera->governor.stats()), cv::Scalar(255, 255, 255));
+				Locator::addText(render->image, Point2D(5, 200), allocationText(camera->allocations.stats()), cv::Scalar(255, 255, 255));
+				camera->locator->print(render->image);
+			}
 		}
-		l.print();
+
+		if (!first.again(1))
+			break;
 	}
+
+	stopping.store(true);
+	for (unique_ptr<Camera> &camera : cameras)
+	{
+		camera->detect.join();
+		camera->publish.join();
+	}
+	table.close();
+	control.join();
 	server.stop();
+
+	// with unpaced replays this is the throughput of the whole pipeline on those recordings
+	const float seconds = duration<float>(steady_clock::now() - started).count();
+	bool allocated = false;
+	for (const unique_ptr<Camera> &camera : cameras)
+	{
+		const CaptureStats capture = camera->locator->captureStats();
+		cout << cv::format(
+					"camera %d: %llu frames in %.2f s, %.1f fps, %llu dropped",
+					camera->index,
+					(unsigned long long)capture.consumed,
+					seconds,
+					capture.consumed / seconds,
+					(unsigned long long)capture.dropped)
+			 << endl;
+		cout << "camera " << camera->index << ": " << governorText(camera->governor.stats()) << endl;
+		cout << "camera " << camera->index << ": " << allocationText(camera->allocations.stats()) << endl;
+		if (adapted_colors_file[0] != '\0')
+		{
+			const string path = cv::format(adapted_colors_file, camera->index);
+			if (camera->detector->exportSettings(*camera->locator, path))
+				cout << "camera " << camera->index << ": colors written to " << path << endl;
+		}
+		if (camera->allocations.stats().steady > 0)
+			allocated = true;
+
+		if (!camera->arena)
+			continue;
+		const ArenaScore &score = camera->score;
+		cout << cv::format(
+					"camera %d arena: %llu of %llu robots found, error %.1f mm mean %.1f mm max, %llu misidentified, %llu false",
+					camera->index,
+					(unsigned long long)score.matched,
+					(unsigned long long)score.expected,
+					score.meanError() * 1000.f,
+					score.maxError * 1000.f,
+					(unsigned long long)score.misidentified,
+					(unsigned long long)score.falseDetections)
+			 << endl;
+	}
+
+	if ((allocation_check || checkAllocations) && allocated)
+	{
+		cout << "detect threads allocated after warm up" << endl;
+		return 1;
+	}
 }